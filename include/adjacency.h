@@ -0,0 +1,75 @@
+#ifndef STKQ_ADJACENCY_H
+#define STKQ_ADJACENCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <xmmintrin.h>
+
+namespace stkq
+{
+    // 一组 StreamVByte 解码实现, 实现见 src/adjacency.cpp, 第一次使用时按 CPUID 选择
+    struct AdjacencyDecoder
+    {
+        const char *name;
+        // 解码 n 个差分编码的 id (control 为 2 位一组的字节数 - 1, data 为变长小端字节) 并求前缀和写入 out,
+        // 返回 data 之后的位置; 可能多读 data 之后至多 16 字节
+        const uint8_t *(*decode)(const uint8_t *control, const uint8_t *data, unsigned n, unsigned *out);
+    };
+
+    // 当前 CPU 支持的全部解码实现, 最后一个为 scalar
+    std::vector<const AdjacencyDecoder *> GetSupportedAdjacencyDecoders();
+
+    // 当前 CPU 上最快的解码实现, STKQ_SIMD=scalar 时同样使用 scalar
+    const AdjacencyDecoder &GetAdjacencyDecoder();
+
+    // DEG 搜索图邻接表的压缩表示, 每个节点一条变长记录:
+    //   出度 n (1 字节, >= 255 时为 255 后跟 4 字节),
+    //   StreamVByte 控制字节 ((n + 3) / 4 字节) 与按 id 升序的差分 (首个为 id 本身, 每个 1 ~ 4 字节),
+    //   每条边的 alpha 区间, 每个区间 2 字节 (lo | 后面还有区间 << 7, hi), 取值截断到 [0, 100].
+    // 不保存 alpha 位图与内联坐标, 边的遍历顺序为 id 升序
+    class CompressedAdjacency
+    {
+    public:
+        // 由 CSR 搜索图 (见 Index::DEGSearchGraph) 编码
+        void Build(size_t node_num, const size_t *offsets, const unsigned *ids, const unsigned *range_offsets,
+                   const std::pair<int8_t, int8_t> *ranges);
+
+        // 节点 u 在 alpha100 = alpha * 100 下有效的邻居按 id 升序写入 out, 返回个数;
+        // 判断与 DEGSearchGraph::IsActive 相同, out 至少需要 MaxDegree() 个元素
+        inline unsigned DecodeActive(unsigned u, float alpha100, unsigned *out) const
+        {
+            return DecodeRecord(bytes_.data() + offsets_[u], alpha100, out, *decoder_);
+        }
+
+        // 单个节点的记录: CSR 中 [begin, end) 的边编码后追加到 out (SSD 模式的节点块同样使用这一格式)
+        static void EncodeRecord(size_t begin, size_t end, const unsigned *ids, const unsigned *range_offsets,
+                                 const std::pair<int8_t, int8_t> *ranges, std::vector<uint8_t> &out);
+
+        // 解码一条记录中有效的邻居, 记录之后需有 16 字节可读
+        static unsigned DecodeRecord(const uint8_t *record, float alpha100, unsigned *out, const AdjacencyDecoder &decoder);
+
+        inline void Prefetch(unsigned u) const
+        {
+            _mm_prefetch((const char *)(bytes_.data() + offsets_[u]), _MM_HINT_T0);
+        }
+
+        size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+        bool empty() const { return offsets_.empty(); }
+        unsigned MaxDegree() const { return max_degree_; }
+        // 占用的字节数 (记录与每个节点的起始偏移)
+        size_t Bytes() const { return bytes_.size() + offsets_.size() * sizeof(uint64_t); }
+
+        // 指定解码实现, 用于测试各实现的一致性
+        void SetDecoder(const AdjacencyDecoder &decoder) { decoder_ = &decoder; }
+
+    private:
+        std::vector<uint64_t> offsets_; // 节点 u 的记录位于 bytes_[offsets_[u], offsets_[u + 1])
+        std::vector<uint8_t> bytes_;    // 末尾另有 16 字节填充, SIMD 解码可以越过最后一条记录读取
+        unsigned max_degree_ = 0;
+        const AdjacencyDecoder *decoder_ = nullptr;
+    };
+}
+
+#endif
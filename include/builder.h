@@ -42,6 +42,9 @@ namespace stkq
 
         IndexBuilder *load_graph(TYPE type, char *graph_file_1, char *graph_file_2);
 
+        // 对已加载的索引做局部性重排 (bfs / rcm / hilbert), 之后 save_graph 写出重排后的图与 id 映射
+        IndexBuilder *reorder(TYPE type, const std::string &method);
+
         IndexBuilder *refine(TYPE type, bool debug);
 
         IndexBuilder *search(TYPE entry_type, TYPE route_type, TYPE L_type, Parameters para_);
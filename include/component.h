@@ -23,6 +23,10 @@ namespace stkq
 
         virtual void LoadInner(char *data_emb_file, char *data_loc_file, char *query_emb_file, char *query_loc_file, char *query_alpha_file, char *ground_file, Parameters &parameters);
 
+        // 把 fvecs / ivecs (按扩展名区分) 转换为原生格式, 每行补齐到 alignment 字节的倍数;
+        // 行无填充 (alignment 整除 dim * 4) 时 LoadInner 可以零拷贝 mmap
+        static void ConvertToNative(const char *src, const char *dst, unsigned alignment = 4);
+
         // virtual void load_partition(char *partition_file);
     };
 
@@ -714,7 +718,7 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchRoute(Index *index) : Component(index) {}
 
-        virtual void RouteInner(unsigned query, std::vector<Index::Neighbor> &pool, std::vector<unsigned> &res) = 0;
+        virtual void RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx, Index::SearchResult &res) = 0;
     };
 
     class ComponentSearchRouteBS4 : public ComponentSearchRoute
@@ -722,13 +726,13 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchRouteBS4(Index *index) : ComponentSearchRoute(index) {}
 
-        void RouteInner(unsigned query, std::vector<Index::Neighbor> &pool, std::vector<unsigned> &res) override;
+        void RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx, Index::SearchResult &res) override;
 
     private:
         // void SearchById_(unsigned query, Index::HnswNode* cur_node, float cur_dist, size_t k,
         //                  size_t ef_search, std::vector<std::pair<Index::HnswNode*, float>> &result);
-        void SearchAtLayer(unsigned qnode, Index::BS4Node *enterpoint, int level,
-                           Index::VisitedList *visited_list,
+        void SearchAtLayer(const Index::SearchRequest &req, Index::BS4Node *enterpoint, int level,
+                           Index::SearchContext *ctx,
                            std::priority_queue<Index::BS4FurtherFirst> &result);
     };
 
@@ -737,7 +741,7 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchRouteGreedy(Index *index) : ComponentSearchRoute(index) {}
 
-        void RouteInner(unsigned query, std::vector<Index::Neighbor> &pool, std::vector<unsigned> &res) override;
+        void RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx, Index::SearchResult &res) override;
     };
 
     class ComponentSearchRouteNSW : public ComponentSearchRoute
@@ -745,11 +749,11 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchRouteNSW(Index *index) : ComponentSearchRoute(index) {}
 
-        void RouteInner(unsigned query, std::vector<Index::Neighbor> &pool, std::vector<unsigned> &res) override;
+        void RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx, Index::SearchResult &res) override;
 
     private:
-        void SearchAtLayer(unsigned qnode, Index::HnswNode *enterpoint, int level,
-                           Index::VisitedList *visited_list,
+        void SearchAtLayer(const Index::SearchRequest &req, Index::HnswNode *enterpoint, int level,
+                           Index::SearchContext *ctx,
                            std::priority_queue<Index::FurtherFirst> &result);
     };
 
@@ -758,13 +762,13 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchRouteHNSW(Index *index) : ComponentSearchRoute(index) {}
 
-        void RouteInner(unsigned query, std::vector<Index::Neighbor> &pool, std::vector<unsigned> &res) override;
+        void RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx, Index::SearchResult &res) override;
 
     private:
         // void SearchById_(unsigned query, Index::HnswNode* cur_node, float cur_dist, size_t k,
         //                  size_t ef_search, std::vector<std::pair<Index::HnswNode*, float>> &result);
-        void SearchAtLayer(unsigned qnode, Index::HnswNode *enterpoint, int level,
-                           Index::VisitedList *visited_list,
+        void SearchAtLayer(const Index::SearchRequest &req, Index::HnswNode *enterpoint, int level,
+                           Index::SearchContext *ctx,
                            std::priority_queue<Index::FurtherFirst> &result);
     };
 
@@ -773,7 +777,7 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchRouteDEG(Index *index) : ComponentSearchRoute(index) {}
 
-        void RouteInner(unsigned query, std::vector<Index::Neighbor> &pool, std::vector<unsigned> &res) override;
+        void RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx, Index::SearchResult &res) override;
 
         bool isInRange(float alpha, const std::vector<std::pair<float, float>> &use_range)
         {
@@ -801,9 +805,15 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     private:
         // void SearchById_(unsigned query, Index::HnswNode* cur_node, float cur_dist, size_t k,
         //                  size_t ef_search, std::vector<std::pair<Index::HnswNode*, float>> &result);
-        void SearchAtLayer(unsigned qnode, Index::DEGNode *enterpoint, int level,
-                           Index::VisitedList *visited_list,
-                           std::priority_queue<Index::DEG_FurtherFirst> &result);
+        unsigned SearchAtLayer(const Index::SearchRequest &req, Index::DEGNode *enterpoint, int level,
+                               Index::SearchContext *ctx, std::vector<Index::Neighbor> &pool);
+
+        void EncodeQuery(const Index::SearchRequest &req, Index::SearchContext *ctx);
+
+        bool EmbDistance(const Index::SearchRequest &req, Index::SearchContext *ctx, unsigned id, float bound, float &e_d);
+
+        // SSD 模式的搜索 (见 Index::OpenDiskIndex), 按精确混合距离升序返回已读取的节点个数, 结果在 ctx->disk_expanded
+        unsigned SearchDisk(const Index::SearchRequest &req, Index::SearchContext *ctx);
     };
 
     // search entry
@@ -812,14 +822,14 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchEntry(Index *index) : Component(index) {}
 
-        virtual void SearchEntryInner(unsigned query, std::vector<Index::Neighbor> &pool) = 0;
+        virtual void SearchEntryInner(const Index::SearchRequest &req, std::vector<Index::Neighbor> &pool) = 0;
     };
 
     // class ComponentSearchEntryCentroid : public ComponentSearchEntry {
     // public:
     //     explicit ComponentSearchEntryCentroid(Index *index) : ComponentSearchEntry(index) {}
 
-    //     void SearchEntryInner(unsigned query, std::vector<Index::Neighbor> &pool) override;
+    //     void SearchEntryInner(const Index::SearchRequest &req, std::vector<Index::Neighbor> &pool) override;
     // };
 
     class ComponentSearchEntryNone : public ComponentSearchEntry
@@ -827,7 +837,7 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchEntryNone(Index *index) : ComponentSearchEntry(index) {}
 
-        void SearchEntryInner(unsigned query, std::vector<Index::Neighbor> &pool) override;
+        void SearchEntryInner(const Index::SearchRequest &req, std::vector<Index::Neighbor> &pool) override;
     };
 
     // entry
@@ -872,7 +882,7 @@ void Hnsw2Neighbor(unsigned query, unsigned range, std::priority_queue<Index::BS
     public:
         explicit ComponentSearchEntryCentroid(Index *index) : ComponentSearchEntry(index) {}
 
-        void SearchEntryInner(unsigned query, std::vector<Index::Neighbor> &pool) override;
+        void SearchEntryInner(const Index::SearchRequest &req, std::vector<Index::Neighbor> &pool) override;
     };
 }
 
@@ -0,0 +1,120 @@
+#ifndef STKQ_DISK_H
+#define STKQ_DISK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace stkq
+{
+    // 按块读取文件的线程池: Read 把一批块的 pread 交给 io 线程并行执行, 调用线程同时参与, 全部完成后返回.
+    // threads 为 0 时由调用线程依次读取
+    class BlockReader
+    {
+    public:
+        BlockReader(int fd, size_t block_size, size_t data_offset, unsigned threads);
+        ~BlockReader();
+
+        BlockReader(const BlockReader &) = delete;
+        BlockReader &operator=(const BlockReader &) = delete;
+
+        // 第 ids[i] 个块读入 buffer + i * block_size; O_DIRECT 打开时 buffer 需按 4096 字节对齐
+        void Read(const unsigned *ids, unsigned n, char *buffer);
+
+    private:
+        struct Batch
+        {
+            const unsigned *ids;
+            unsigned n;
+            char *buffer;
+            std::atomic<unsigned> next{0};  // 下一个待读取的块
+            std::atomic<unsigned> done{0};  // 已读完的块数
+            std::atomic<unsigned> users{0}; // 正在处理该批次的 io 线程数
+        };
+
+        void RunBatch(Batch &batch);
+        void ReadBlock(unsigned id, char *dst) const;
+        void Worker();
+
+        int fd_;
+        size_t block_size_;
+        size_t data_offset_;
+        std::vector<std::thread> threads_;
+        std::deque<Batch *> queue_;
+        std::mutex lock_;
+        std::condition_variable work_cv_;
+        std::condition_variable done_cv_;
+        bool stop_ = false;
+    };
+
+    // SSD 模式的磁盘索引: 文件头之后每个节点一个 4096 字节对齐的定长块,
+    // 块内依次为 float embedding 与该节点的压缩邻接记录 (见 CompressedAdjacency::EncodeRecord).
+    // 内存中只保留 SQ8 / PQ 编码、空间坐标与入口点, 遍历时按块读取邻接表, 并用块中的原始向量重排
+    class DiskIndex
+    {
+    public:
+        static constexpr size_t kBlockAlign = 4096;
+
+        struct Header
+        {
+            char magic[8]; // "STKQDSK\0"
+            uint32_t version;
+            uint32_t emb_dim;
+            uint64_t node_num;
+            uint64_t edge_num;
+            uint64_t graph_hash; // 写入时 CSR 搜索图的摘要, 图或 id 顺序改变后文件失效
+            uint64_t block_size;
+            uint64_t data_offset;
+            uint32_t max_degree;
+        };
+
+        DiskIndex() = default;
+        ~DiskIndex() { Close(); }
+
+        DiskIndex(const DiskIndex &) = delete;
+        DiskIndex &operator=(const DiskIndex &) = delete;
+
+        // CSR 搜索图 (见 Index::DEGSearchGraph) 的摘要, 用于判断磁盘索引是否与当前图一致
+        static uint64_t GraphHash(size_t node_num, const size_t *offsets, const unsigned *ids);
+
+        // 把 base embedding 与 CSR 搜索图写成磁盘索引
+        static void Write(const char *file, size_t node_num, const float *emb, unsigned emb_dim, const size_t *offsets,
+                          const unsigned *ids, const unsigned *range_offsets, const std::pair<int8_t, int8_t> *ranges);
+
+        // 打开磁盘索引, 头部与 node_num / emb_dim / graph_hash 不一致或文件不存在时返回 false;
+        // direct 为 true 时用 O_DIRECT 绕过页缓存 (文件系统不支持时退回普通读取)
+        bool Open(const char *file, size_t node_num, unsigned emb_dim, uint64_t graph_hash, bool direct,
+                  unsigned io_threads);
+
+        void Close();
+
+        bool opened() const { return reader_ != nullptr; }
+        bool direct() const { return direct_; }
+        const Header &header() const { return header_; }
+        size_t BlockSize() const { return header_.block_size; }
+        size_t FileBytes() const { return header_.data_offset + header_.node_num * header_.block_size; }
+
+        inline void Read(const unsigned *ids, unsigned n, char *buffer) const { reader_->Read(ids, n, buffer); }
+
+        // 块中的 embedding 与压缩邻接记录
+        inline const float *BlockEmb(const char *block) const { return (const float *)block; }
+        inline const uint8_t *BlockRecord(const char *block) const
+        {
+            return (const uint8_t *)block + (size_t)header_.emb_dim * sizeof(float);
+        }
+
+    private:
+        Header header_{};
+        int fd_ = -1;
+        bool direct_ = false;
+        BlockReader *reader_ = nullptr;
+    };
+}
+
+#endif
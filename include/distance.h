@@ -1,71 +1,90 @@
 #ifndef STKQ_DISTANCE_H
 #define STKQ_DISTANCE_H
-#include <immintrin.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 #define PORTABLE_ALIGN32 __attribute__((aligned(32)))
 #define PORTABLE_ALIGN64 __attribute__((aligned(64)))
 
 namespace stkq
 {
+    // 同一指令集实现的一组距离 kernel, 实现见 src/distance.cpp
+    // 第一次使用时按 CPUID 选择, 不依赖编译时的 -march
+    struct DistanceKernels
+    {
+        const char *name;
+        unsigned dim; // 按维数特化时的维数, 此时 L 必须等于 dim; 0 表示任意维数
+        // a, b 前 L 维的平方欧氏距离
+        float (*sqr_dist)(const float *a, const float *b, unsigned L);
+        // 累加顺序与 sqr_dist 相同, 每 32 维检查一次部分和, 超过 bound_sqr 时提前返回 false
+        // 返回 true 时 sqr 与 sqr_dist 的结果完全一致; scanned 为实际扫描的维数
+        bool (*sqr_dist_bounded)(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                 unsigned &scanned);
+        // 与上面两个结果完全一致, 但 a, b 必须 64 字节对齐, 主循环使用对齐读取 (_mm512_load_ps 等)
+        float (*sqr_dist_aligned)(const float *a, const float *b, unsigned L);
+        bool (*sqr_dist_bounded_aligned)(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                         unsigned &scanned);
+        // 二维坐标一对多: out[i] = |base[ids[i]] - q|^2, 跨候选点向量化, 要求 ids[i] * 2 不超过 int32 范围
+        void (*sqr_dist_2d_batch)(const float *base, const float *q, const unsigned *ids, unsigned n, float *out);
+        // SQ8 编码的平方距离 (整数), 768 维时最大约 5e7, 不会溢出
+        uint32_t (*sqr_dist_u8)(const uint8_t *a, const uint8_t *b, unsigned L);
+        // float 与 fp16 / bf16 存储的向量之间的平方距离, b 在寄存器中转换为 float (F16C / AVX-512)
+        float (*sqr_dist_f16)(const float *a, const uint16_t *b, unsigned L);
+        float (*sqr_dist_bf16)(const float *a, const uint16_t *b, unsigned L);
+        // 两个二进制码 (words 个 uint64) 之间的 hamming 距离
+        uint32_t (*hamming)(const uint64_t *a, const uint64_t *b, unsigned words);
+    };
 
-    class E_Distance
+    // base embedding 的存储精度
+    enum EmbPrecision
     {
-    public:
-        template <typename T>
-        inline float sqr_dist(const T *d, const T *q, unsigned L) const
-        {
-            float PORTABLE_ALIGN32 TmpRes[8] = {0};
-            uint32_t num_blk16 = L >> 4;
-            uint32_t l = L & 0b1111;
+        EMB_FLOAT32 = 0,
+        EMB_FLOAT16,
+        EMB_BFLOAT16
+    };
 
-            __m256 diff, v1, v2;
-            __m256 sum = _mm256_set1_ps(0);
-            for (uint32_t i = 0; i < num_blk16; i++)
-            {
-                v1 = _mm256_loadu_ps(d);
-                v2 = _mm256_loadu_ps(q);
-                d += 8;
-                q += 8;
-                diff = _mm256_sub_ps(v1, v2);
-                sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
-
-                v1 = _mm256_loadu_ps(d);
-                v2 = _mm256_loadu_ps(q);
-                d += 8;
-                q += 8;
-                diff = _mm256_sub_ps(v1, v2);
-                sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
-            }
-            for (uint32_t i = 0; i < l / 8; i++)
-            {
-                v1 = _mm256_loadu_ps(d);
-                v2 = _mm256_loadu_ps(q);
-                d += 8;
-                q += 8;
-                diff = _mm256_sub_ps(v1, v2);
-                sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
-            }
-            _mm256_store_ps(TmpRes, sum);
+    // float 转换为 fp16 / bf16, 就近舍入 (ties to even), 用于加载时转换 base embedding
+    void ConvertFloatToHalf(const float *src, uint16_t *dst, size_t n, EmbPrecision precision);
 
-            float ret = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] +
-                        TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+    // 单个 fp16 / bf16 值转换回 float
+    float HalfToFloat(uint16_t h, EmbPrecision precision);
 
-            for (uint32_t i = 0; i < l % 8; i++)
-            {
-                float tmp = (*q) - (*d);
-                ret += tmp * tmp;
-                d++;
-                q++;
-            }
-            return ret;
-        }
+    // 当前 CPU 上最宽的可用 kernel (avx512 > avx2 > sse > scalar),
+    // 环境变量 STKQ_SIMD=avx512|avx2|sse|scalar 可强制指定
+    const DistanceKernels &GetDistanceKernels();
 
-        template <typename T>
-        T compare(const T *a, const T *b, unsigned length) const
+    // 当前 CPU 支持的全部 kernel, 从宽到窄排列, 最后一个为 scalar
+    std::vector<const DistanceKernels *> GetSupportedDistanceKernels();
+
+    // kernels 针对固定维数 dim 的特化版本 (循环次数为编译期常量, 无尾部处理),
+    // 目前特化 2 (空间坐标) 与 512 / 768 / 1024 (embedding), 其他维数返回 kernels 本身
+    const DistanceKernels &SpecializeDistanceKernels(const DistanceKernels &kernels, unsigned dim);
+
+    class E_Distance
+    {
+    public:
+        inline float compare(const float *a, const float *b, unsigned length) const
         {
-            T emb_distance = sqr_dist(a, b, length);
+            float emb_distance = kernels_->sqr_dist(a, b, length);
             return std::sqrt(emb_distance) / max_emb_dist;
         }
 
+        // 带阈值的距离: 部分平方和超过 bound (归一化后的距离) 时提前终止并返回 false
+        // 未终止时 dist 与 compare 的结果完全一致; scanned 为实际扫描的维数
+        // aligned 为 true 时调用方保证 a, b 均为 64 字节对齐, 使用对齐读取的 kernel
+        inline bool compare_bounded(const float *a, const float *b, unsigned length, float bound, float &dist,
+                                    unsigned &scanned, bool aligned = false) const
+        {
+            const float bound_sqr = bound * max_emb_dist * bound * max_emb_dist;
+            float emb_distance;
+            if (!(aligned ? kernels_->sqr_dist_bounded_aligned : kernels_->sqr_dist_bounded)(a, b, length, bound_sqr,
+                                                                                           emb_distance, scanned))
+                return false;
+            dist = std::sqrt(emb_distance) / max_emb_dist;
+            return true;
+        }
+
         // template <typename T>
         // T compare(const T *a, const T *b, unsigned length) const
         // {
@@ -104,10 +123,58 @@ namespace stkq
         //     return std::sqrt(emb_distance) / max_emb_dist;
         // }
 
-        E_Distance(float max_emb_dist) : max_emb_dist(max_emb_dist) {}
+        // SQ8 编码之间的距离, step 为量化步长, 结果与浮点 compare 同量纲
+        inline float compare_sq8(const uint8_t *a, const uint8_t *b, unsigned length, float step) const
+        {
+            return std::sqrt((float)kernels_->sqr_dist_u8(a, b, length)) * step / max_emb_dist;
+        }
+
+        // b 为 fp16 / bf16 存储的 embedding, 距离与 compare 同量纲
+        inline float compare_half(const float *a, const uint16_t *b, unsigned length, EmbPrecision precision) const
+        {
+            float emb_distance = precision == EMB_BFLOAT16 ? kernels_->sqr_dist_bf16(a, b, length)
+                                                           : kernels_->sqr_dist_f16(a, b, length);
+            return std::sqrt(emb_distance) / max_emb_dist;
+        }
+
+        // 已算好的平方距离 (如 PQ 查表之和) 换算为与 compare 同量纲的距离
+        inline float from_sqr(float sqr) const
+        {
+            return std::sqrt(sqr) / max_emb_dist;
+        }
+
+        // 一对多: 计算 q 到 base 中 ids[0..n) 各点的距离, 写入 out
+        // dim == 2 (空间坐标) 时跨候选点向量化, 否则逐点计算
+        inline void compare_batch(const float *base, unsigned dim, const float *q, const unsigned *ids, unsigned n,
+                                  float *out) const
+        {
+            if (dim == 2)
+            {
+                kernels_->sqr_dist_2d_batch(base, q, ids, n, out);
+                for (unsigned i = 0; i < n; i++)
+                    out[i] = std::sqrt(out[i]) / max_emb_dist;
+                return;
+            }
+            for (unsigned i = 0; i < n; i++)
+                out[i] = compare(base + (size_t)ids[i] * dim, q, dim);
+        }
+
+        // 数据维数确定后调用一次, 之后 compare 只能用于该维数
+        void specialize(unsigned dim)
+        {
+            kernels_ = &SpecializeDistanceKernels(GetDistanceKernels(), dim);
+        }
+
+        const DistanceKernels &kernels() const
+        {
+            return *kernels_;
+        }
+
+        E_Distance(float max_emb_dist) : max_emb_dist(max_emb_dist), kernels_(&GetDistanceKernels()) {}
 
     private:
         float max_emb_dist = 0;
+        const DistanceKernels *kernels_;
     };
 
     class S_Distance
@@ -3,6 +3,7 @@
 
 #include <omp.h>
 #include <mutex>
+#include <atomic>
 #include <queue>
 #include <stack>
 #include <thread>
@@ -17,18 +18,30 @@
 #include <set>
 #include <functional>
 #include <map>
+#include <memory>
 #include <unordered_set>
 #include <boost/dynamic_bitset.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/heap/d_ary_heap.hpp>
 #include "util.h"
 #include "distance.h"
+#include "pq.h"
+#include "adjacency.h"
+#include "disk.h"
 #include "parameters.h"
 #include "policy.h"
 #include "rtree.h"
 #include "CommonDataStructure.h"
+#include <xmmintrin.h>
 #include <mm_malloc.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef STKQ_NUMA
+#include <numa.h>
+#include <sched.h>
+#endif
 #define INF_N -std::numeric_limits<float>::max()
 #define INF_P std::numeric_limits<float>::max()
 
@@ -548,16 +561,286 @@ namespace stkq
             }
         };
 
-        struct DEGSimpleNeighbor
+        // alpha 区间在索引文件和搜索图中按 0.01 量化为 int8
+        static inline int8_t QuantizeAlpha(float alpha)
         {
-            unsigned id_;
-            // unsigned layer_;
-            // std::vector<std::pair<float, float>> available_range;
-            std::vector<std::pair<int8_t, int8_t>> active_range;
+            return static_cast<int8_t>(alpha * 100);
+        }
+
+        // 搜索图中的一个数组: 自有存储 (std::vector), 或直接指向 mmap 的索引文件 (见 Map), 两种情况读取方式相同.
+        // 追加操作先把映射的内容复制为自有存储; 复制一个 GraphArray 时总是得到自有存储 (NUMA 放置依赖这一点)
+        template <typename T>
+        class GraphArray
+        {
+        public:
+            GraphArray() = default;
+            GraphArray(std::vector<T> &&values) : own_(std::move(values)) { Sync(); }
+            GraphArray(const GraphArray &other) : own_(other.begin(), other.end()) { Sync(); }
+            GraphArray(GraphArray &&other) noexcept : own_(std::move(other.own_)), data_(other.data_), size_(other.size_)
+            {
+                other.own_.clear();
+                other.Sync();
+            }
+            GraphArray &operator=(GraphArray other) noexcept
+            {
+                own_.swap(other.own_);
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                return *this;
+            }
+
+            // 指向外部 (映射) 内存, 由调用方保证其生命周期
+            void Map(const T *data, size_t size)
+            {
+                std::vector<T>().swap(own_);
+                data_ = data;
+                size_ = size;
+            }
+
+            void reserve(size_t n)
+            {
+                Own();
+                own_.reserve(n);
+                Sync();
+            }
+
+            inline void push_back(const T &value)
+            {
+                Own();
+                own_.push_back(value);
+                Sync();
+            }
+
+            inline void append(const T *first, const T *last)
+            {
+                Own();
+                own_.insert(own_.end(), first, last);
+                Sync();
+            }
+
+            inline const T &operator[](size_t i) const { return data_[i]; }
+            inline const T *data() const { return data_; }
+            inline const T *begin() const { return data_; }
+            inline const T *end() const { return data_ + size_; }
+            inline size_t size() const { return size_; }
+            inline bool empty() const { return size_ == 0; }
+
+        private:
+            void Own()
+            {
+                if (data_ != own_.data())
+                    own_.assign(begin(), end());
+            }
+
+            void Sync()
+            {
+                data_ = own_.data();
+                size_ = own_.size();
+            }
+
+            std::vector<T> own_;
+            const T *data_ = nullptr;
+            size_t size_ = 0;
+        };
+
+        // 只读搜索图的 CSR 布局, 节点 u 的出边为 [offsets[u], offsets[u + 1]),
+        // 边 e 的目标为 ids[e], 其 alpha 有效区间为 ranges[range_offsets[e] .. range_offsets[e + 1]).
+        // 各数组可以直接映射自 SaveDEGIndex 写出的索引文件, 此时 mapping 持有该映射
+        struct DEGSearchGraph
+        {
+            GraphArray<size_t> offsets{std::vector<size_t>{0}};
+            GraphArray<unsigned> ids;
+            GraphArray<unsigned> range_offsets{std::vector<unsigned>{0}};
+            GraphArray<std::pair<int8_t, int8_t>> ranges;
+
+            // 每条边 128 位的 alpha 桶位图, 拆成低 / 高两个 64 位平面按边连续存放.
+            // 第 k 位 (k = 0..100) 表示 alpha * 100 = k 时该边有效; 最高位 SPLIT_FLAG 表示该边存在首尾相接的
+            // 两个区间 [.., k] [k + 1, ..], 此时 (k, k + 1) 内的 alpha 不能只看位图, 需要回退到区间判断
+            GraphArray<uint64_t> active_lo;
+            GraphArray<uint64_t> active_hi;
+            static constexpr uint64_t SPLIT_FLAG = 1ULL << 63;
+
+            // 每条边终点的二维坐标 (x, y), 与 ids 同序连续存放, 扩展节点时空间距离无需随机访问 base_loc_data_;
+            // 空间维数不为 2 时为空
+            GraphArray<float> locs;
+
+            std::shared_ptr<void> mapping;
+
+            // 单个查询的 alpha 在位图上要求置位的比特
+            struct AlphaMask
+            {
+                uint64_t lo = 0, hi = 0;
+                bool fractional = false; // alpha * 100 不是整数
+                bool none = false;       // alpha 超出 [0, 1], 任何边都无效
+                float alpha100 = 0;
+            };
+
+            void clear()
+            {
+                *this = DEGSearchGraph();
+            }
+
+            void reserve(size_t node_num, size_t edge_num)
+            {
+                offsets.reserve(node_num + 1);
+                ids.reserve(edge_num);
+                range_offsets.reserve(edge_num + 1);
+                ranges.reserve(edge_num);
+            }
+
+            inline void AddEdge(unsigned id, const std::pair<int8_t, int8_t> *range, unsigned range_size)
+            {
+                ids.push_back(id);
+                ranges.append(range, range + range_size);
+                range_offsets.push_back(ranges.size());
+            }
+
+            // 当前节点的边全部加入后调用
+            inline void FinishNode() { offsets.push_back(ids.size()); }
+
+            inline size_t size() const { return offsets.size() - 1; }
+
+            inline size_t EdgeBegin(unsigned u) const { return offsets[u]; }
+
+            inline size_t EdgeEnd(unsigned u) const { return offsets[u + 1]; }
+
+            // 预取节点 u 的邻接表与边位图
+            inline void Prefetch(unsigned u) const
+            {
+                const size_t e = offsets[u];
+                _mm_prefetch((const char *)(ids.data() + e), _MM_HINT_T0);
+                _mm_prefetch((const char *)(active_lo.data() + e), _MM_HINT_T0);
+                _mm_prefetch((const char *)(active_hi.data() + e), _MM_HINT_T0);
+                if (!locs.empty())
+                    _mm_prefetch((const char *)(locs.data() + 2 * e), _MM_HINT_T0);
+            }
+
+            // 把每条边终点的坐标复制到 locs, 在 ids 确定之后调用;
+            // 批量 kernel 以 32 位下标 gather, 边数的两倍超过 int32 范围时同样不内联
+            void BuildInlineLocs(const float *base_loc, unsigned loc_dim)
+            {
+                locs = GraphArray<float>();
+                if (loc_dim != 2 || ids.size() * 2 > (size_t)INT32_MAX)
+                    return;
+                std::vector<float> inline_locs(ids.size() * 2);
+                for (size_t e = 0; e < ids.size(); e++)
+                {
+                    inline_locs[2 * e] = base_loc[(size_t)ids[e] * 2];
+                    inline_locs[2 * e + 1] = base_loc[(size_t)ids[e] * 2 + 1];
+                }
+                locs = std::move(inline_locs);
+            }
+
+            // 索引文件中保存的内联坐标是否与当前 (重排后) 的 base 坐标一致, 只抽查开头的若干条边
+            bool InlineLocsMatch(const float *base_loc, unsigned loc_dim) const
+            {
+                if (loc_dim != 2 || locs.size() != ids.size() * 2)
+                    return false;
+                for (size_t e = 0; e < std::min<size_t>(ids.size(), 256); e++)
+                    if (locs[2 * e] != base_loc[(size_t)ids[e] * 2] || locs[2 * e + 1] != base_loc[(size_t)ids[e] * 2 + 1])
+                        return false;
+                return true;
+            }
 
-            DEGSimpleNeighbor() = default;
-            // DEGSimpleNeighbor(unsigned id, std::vector<std::pair<float, float>> range) : id_{id}, available_range(range) {}
-            DEGSimpleNeighbor(unsigned id, std::vector<std::pair<int8_t, int8_t>> range) : id_{id}, active_range(range) {}
+            inline bool HasInlineLocs() const { return !locs.empty(); }
+
+            // 各数组占用的字节数
+            size_t Bytes() const
+            {
+                return offsets.size() * sizeof(size_t) + ids.size() * sizeof(unsigned) +
+                       range_offsets.size() * sizeof(unsigned) + ranges.size() * sizeof(ranges[0]) +
+                       (active_lo.size() + active_hi.size()) * sizeof(uint64_t) + locs.size() * sizeof(float);
+            }
+
+            // alpha100 = alpha * 100, 区间有序, 与原 active_range 的判断方式一致
+            inline bool IsActive(size_t e, float alpha100) const
+            {
+                for (unsigned r = range_offsets[e]; r < range_offsets[e + 1]; r++)
+                {
+                    if (alpha100 < ranges[r].first)
+                        return false;
+                    if (alpha100 <= ranges[r].second)
+                        return true;
+                }
+                return false;
+            }
+
+            // 由 ranges 生成 active_lo / active_hi, 在 load_graph 和 BuildDEGSearchGraph 之后调用
+            void BuildActiveMasks()
+            {
+                const size_t edge_num = ids.size();
+                std::vector<uint64_t> lo(edge_num, 0), hi(edge_num, 0);
+                for (size_t e = 0; e < edge_num; e++)
+                {
+                    int prev_end = -2;
+                    for (unsigned r = range_offsets[e]; r < range_offsets[e + 1]; r++)
+                    {
+                        int first = std::max<int>(ranges[r].first, 0);
+                        int second = std::min<int>(ranges[r].second, 100);
+                        if (ranges[r].first == prev_end + 1)
+                            hi[e] |= SPLIT_FLAG;
+                        prev_end = ranges[r].second;
+                        for (int k = first; k <= second; k++)
+                        {
+                            if (k < 64)
+                                lo[e] |= 1ULL << k;
+                            else
+                                hi[e] |= 1ULL << (k - 64);
+                        }
+                    }
+                }
+                active_lo = std::move(lo);
+                active_hi = std::move(hi);
+            }
+
+            // alpha100 落在整数 k 上只需第 k 位; 落在 (k, k + 1) 内需要第 k 和 k + 1 位同时置位
+            static AlphaMask MakeAlphaMask(float alpha100)
+            {
+                AlphaMask mask;
+                mask.alpha100 = alpha100;
+                if (!(alpha100 >= 0 && alpha100 <= 100))
+                {
+                    mask.none = true;
+                    return mask;
+                }
+                const int k = static_cast<int>(alpha100);
+                mask.fractional = (alpha100 != static_cast<float>(k));
+                for (int b = k; b <= k + (mask.fractional ? 1 : 0); b++)
+                {
+                    if (b < 64)
+                        mask.lo |= 1ULL << b;
+                    else
+                        mask.hi |= 1ULL << (b - 64);
+                }
+                return mask;
+            }
+
+            // 返回 [begin, begin + n) (n <= 64) 中有效边的位掩码, 第 j 位对应边 begin + j
+            inline uint64_t ActiveMask(size_t begin, unsigned n, const AlphaMask &mask) const
+            {
+                if (mask.none)
+                    return 0;
+                const uint64_t *lo = active_lo.data() + begin;
+                const uint64_t *hi = active_hi.data() + begin;
+                uint64_t active = 0, split = 0;
+                for (unsigned j = 0; j < n; j++)
+                {
+                    active |= (uint64_t)(((lo[j] & mask.lo) == mask.lo) & ((hi[j] & mask.hi) == mask.hi)) << j;
+                    split |= (hi[j] >> 63) << j;
+                }
+                if (mask.fractional)
+                {
+                    uint64_t check = active & split;
+                    while (check)
+                    {
+                        unsigned j = __builtin_ctzll(check);
+                        check &= check - 1;
+                        if (!IsActive(begin + j, mask.alpha100))
+                            active &= ~(1ULL << j);
+                    }
+                }
+                return active;
+            }
         };
 
         struct DEGNNDescentNeighbor
@@ -586,9 +869,7 @@ namespace stkq
                 : id_(id), max_m_(max_m)
             {
                 // friends.reserve(max_m_ + 1);
-                // friends_for_search.reserve(max_m_ + 1);
                 friends.clear();
-                friends_for_search.clear();
             }
 
             inline int GetId() const { return id_; }
@@ -604,13 +885,6 @@ namespace stkq
                 friends.swap(new_friends);
             }
 
-            inline std::vector<DEGSimpleNeighbor> &GetSearchFriends() { return friends_for_search; }
-
-            inline void SetSearchFriends(std::vector<DEGSimpleNeighbor> &new_friends)
-            {
-                friends_for_search.swap(new_friends);
-            }
-
             inline std::mutex &GetAccessGuard() { return access_guard_; }
 
         private:
@@ -618,7 +892,6 @@ namespace stkq
             // int level_;
             size_t max_m_;
             std::vector<DEGNeighbor> friends;
-            std::vector<DEGSimpleNeighbor> friends_for_search;
             std::mutex access_guard_;
         };
 
@@ -977,11 +1250,11 @@ namespace stkq
         class DEG_FurtherFirst
         {
         public:
-            DEG_FurtherFirst(DEGNode *node, float emb_distance, float geo_distance, float dist) : node_(node), emb_distance_(emb_distance), geo_distance_(geo_distance), dist_(dist) {}
+            DEG_FurtherFirst(unsigned id, float emb_distance, float geo_distance, float dist) : id_(id), emb_distance_(emb_distance), geo_distance_(geo_distance), dist_(dist) {}
             inline float GetEmbDistance() const { return emb_distance_; }
             inline float GetLocDistance() const { return geo_distance_; }
             inline float GetDistance() const { return dist_; }
-            inline DEGNode *GetNode() const { return node_; }
+            inline unsigned GetId() const { return id_; }
             bool operator<(const DEG_FurtherFirst &n) const
             {
                 return (dist_ < n.GetDistance());
@@ -989,7 +1262,7 @@ namespace stkq
             }
 
         private:
-            DEGNode *node_;
+            unsigned id_;
             float emb_distance_;
             float geo_distance_;
             float dist_;
@@ -998,11 +1271,11 @@ namespace stkq
         class DEG_CloserFirst
         {
         public:
-            DEG_CloserFirst(DEGNode *node, float emb_distance, float geo_distance, float dist) : node_(node), emb_distance_(emb_distance), geo_distance_(geo_distance), dist_(dist) {}
+            DEG_CloserFirst(unsigned id, float emb_distance, float geo_distance, float dist) : id_(id), emb_distance_(emb_distance), geo_distance_(geo_distance), dist_(dist) {}
             inline float GetEmbDistance() const { return emb_distance_; }
             inline float GetLocDistance() const { return geo_distance_; }
             inline float GetDistance() const { return dist_; }
-            inline DEGNode *GetNode() const { return node_; }
+            inline unsigned GetId() const { return id_; }
             bool operator<(const DEG_CloserFirst &n) const
             {
                 return (dist_ > n.GetDistance());
@@ -1010,7 +1283,7 @@ namespace stkq
             }
 
         private:
-            DEGNode *node_;
+            unsigned id_;
             float emb_distance_;
             float geo_distance_;
             float dist_;
@@ -1054,8 +1327,207 @@ namespace stkq
             float geo_distance_;
         };
 
+        // 由构建后的 friends 生成只读搜索图, 与 save_graph 写出的索引内容一致
+        void BuildDEGSearchGraph(const float *base_loc, unsigned loc_dim)
+        {
+            size_t edge_num = 0;
+            for (auto *node : DEG_nodes_)
+                edge_num += node->GetFriends().size();
+
+            DEG_search_graph_.clear();
+            DEG_search_graph_.reserve(DEG_nodes_.size(), edge_num);
+            std::vector<std::pair<int8_t, int8_t>> use_range;
+            for (auto *node : DEG_nodes_)
+            {
+                for (const auto &neighbor : node->GetFriends())
+                {
+                    use_range.clear();
+                    for (const auto &range : neighbor.available_range)
+                        use_range.emplace_back(QuantizeAlpha(range.first), QuantizeAlpha(range.second));
+                    DEG_search_graph_.AddEdge(neighbor.id_, use_range.data(), use_range.size());
+                }
+                DEG_search_graph_.FinishNode();
+            }
+            DEG_search_graph_.BuildActiveMasks();
+            DEG_search_graph_.BuildInlineLocs(base_loc, loc_dim);
+
+            enterpoint_set.clear();
+            for (auto *node : DEG_enterpoints)
+                enterpoint_set.push_back(node->GetId());
+        }
+
+        // DEG 索引文件 (version 1): 文件头之后依次为 DEGFileSection 中的各段, 每段起点按 64 字节对齐,
+        // 内容与 DEGSearchGraph 对应数组的内存布局完全一致, 加载时可以 mmap 后直接在文件上搜索.
+        // 空间维数为 2 时附带每条边终点的内联坐标, 否则 DEG_SEC_LOCS 段为空
+        static inline const char *DEGFileMagic() { return "STKQDEG"; } // 连同结尾的 '\0' 共 8 字节
+        static constexpr uint32_t kDEGFileVersion = 1;
+
+        enum DEGFileSection
+        {
+            DEG_SEC_ENTERPOINTS = 0,
+            DEG_SEC_OFFSETS,
+            DEG_SEC_IDS,
+            DEG_SEC_RANGE_OFFSETS,
+            DEG_SEC_RANGES,
+            DEG_SEC_ACTIVE_LO,
+            DEG_SEC_ACTIVE_HI,
+            DEG_SEC_LOCS,
+            DEG_SEC_NUM
+        };
+
+        struct DEGFileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t enterpoint_num;
+            uint64_t node_num;
+            uint64_t edge_num;
+            uint64_t range_num;
+            uint64_t section_offset[DEG_SEC_NUM];
+            uint64_t section_bytes[DEG_SEC_NUM];
+            uint64_t file_bytes;
+        };
+
+        // 把 DEG_search_graph_ 与入口点写成上面的格式, 每段一次写出.
+        // 先写到 <graph_file>.tmp 再 rename: 搜索图可能正映射自 graph_file 本身, 不能原地截断
+        void SaveDEGIndex(const char *graph_file) const
+        {
+            const DEGSearchGraph &g = DEG_search_graph_;
+            const void *section_data[DEG_SEC_NUM] = {enterpoint_set.data(), g.offsets.data(), g.ids.data(),
+                                                     g.range_offsets.data(), g.ranges.data(), g.active_lo.data(),
+                                                     g.active_hi.data(), g.locs.data()};
+            DEGFileHeader header{};
+            memcpy(header.magic, DEGFileMagic(), sizeof(header.magic));
+            header.version = kDEGFileVersion;
+            header.enterpoint_num = enterpoint_set.size();
+            header.node_num = g.size();
+            header.edge_num = g.ids.size();
+            header.range_num = g.ranges.size();
+            header.section_bytes[DEG_SEC_ENTERPOINTS] = enterpoint_set.size() * sizeof(unsigned);
+            header.section_bytes[DEG_SEC_OFFSETS] = g.offsets.size() * sizeof(size_t);
+            header.section_bytes[DEG_SEC_IDS] = g.ids.size() * sizeof(unsigned);
+            header.section_bytes[DEG_SEC_RANGE_OFFSETS] = g.range_offsets.size() * sizeof(unsigned);
+            header.section_bytes[DEG_SEC_RANGES] = g.ranges.size() * sizeof(g.ranges[0]);
+            header.section_bytes[DEG_SEC_ACTIVE_LO] = g.active_lo.size() * sizeof(uint64_t);
+            header.section_bytes[DEG_SEC_ACTIVE_HI] = g.active_hi.size() * sizeof(uint64_t);
+            header.section_bytes[DEG_SEC_LOCS] = g.locs.size() * sizeof(float);
+            uint64_t pos = (sizeof(DEGFileHeader) + 63) / 64 * 64;
+            for (unsigned sec = 0; sec < DEG_SEC_NUM; sec++)
+            {
+                header.section_offset[sec] = pos;
+                pos += (header.section_bytes[sec] + 63) / 64 * 64;
+            }
+            header.file_bytes = pos;
+
+            const std::string tmp_file = std::string(graph_file) + ".tmp";
+            std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                std::cerr << "save graph error: " << graph_file << std::endl;
+                exit(-1);
+            }
+            static const char padding[64] = {};
+            out.write((const char *)&header, sizeof(header));
+            out.write(padding, header.section_offset[0] - sizeof(header));
+            for (unsigned sec = 0; sec < DEG_SEC_NUM; sec++)
+            {
+                out.write((const char *)section_data[sec], header.section_bytes[sec]);
+                out.write(padding, (64 - header.section_bytes[sec] % 64) % 64);
+            }
+            out.close();
+            if (!out || std::rename(tmp_file.c_str(), graph_file) != 0)
+            {
+                std::cerr << "save graph error: " << graph_file << std::endl;
+                exit(-1);
+            }
+        }
+
+        // 加载 SaveDEGIndex 写出的索引: mmap 整个文件, 搜索图的各数组直接指向映射 (只读, 各进程共享页缓存);
+        // copy 为 true 时复制为自有存储后释放映射. populate 为 true 时用 MAP_POPULATE 在加载时一次读入所有页.
+        // 文件不是该格式时返回 false, 由调用方按旧格式解析
+        bool LoadDEGIndex(const char *graph_file, unsigned node_num, bool copy, bool populate)
+        {
+            DEGFileHeader header;
+            int fd = open(graph_file, O_RDONLY);
+            if (fd < 0)
+            {
+                std::cerr << "load graph error: " << graph_file << std::endl;
+                exit(-1);
+            }
+            if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+                memcmp(header.magic, DEGFileMagic(), sizeof(header.magic)) != 0)
+            {
+                close(fd);
+                return false;
+            }
+            struct stat st;
+            bool valid = header.version == kDEGFileVersion && header.node_num == node_num && fstat(fd, &st) == 0 &&
+                         (uint64_t)st.st_size >= header.file_bytes;
+            const uint64_t expect_bytes[DEG_SEC_NUM] = {
+                header.enterpoint_num * sizeof(unsigned), (header.node_num + 1) * sizeof(size_t),
+                header.edge_num * sizeof(unsigned), (header.edge_num + 1) * sizeof(unsigned),
+                header.range_num * sizeof(std::pair<int8_t, int8_t>), header.edge_num * sizeof(uint64_t),
+                header.edge_num * sizeof(uint64_t), header.edge_num * 2 * sizeof(float)};
+            for (unsigned sec = 0; sec < DEG_SEC_NUM && valid; sec++)
+                valid = header.section_offset[sec] % 64 == 0 &&
+                        (header.section_bytes[sec] == expect_bytes[sec] || (sec == DEG_SEC_LOCS && header.section_bytes[sec] == 0)) &&
+                        header.section_offset[sec] + header.section_bytes[sec] <= header.file_bytes;
+            if (!valid)
+            {
+                std::cerr << "unsupported or truncated DEG index: " << graph_file << std::endl;
+                exit(-1);
+            }
+            void *p = mmap(nullptr, header.file_bytes, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+            close(fd);
+            if (p == MAP_FAILED)
+            {
+                std::cerr << "mmap graph error: " << graph_file << std::endl;
+                exit(-1);
+            }
+            const size_t length = header.file_bytes;
+            auto section = [&](unsigned sec)
+            { return (const char *)p + header.section_offset[sec]; };
+
+            DEGSearchGraph &g = DEG_search_graph_;
+            g.clear();
+            g.mapping = std::shared_ptr<void>(p, [length](void *addr)
+                                              { munmap(addr, length); });
+            g.offsets.Map((const size_t *)section(DEG_SEC_OFFSETS), header.node_num + 1);
+            g.ids.Map((const unsigned *)section(DEG_SEC_IDS), header.edge_num);
+            g.range_offsets.Map((const unsigned *)section(DEG_SEC_RANGE_OFFSETS), header.edge_num + 1);
+            g.ranges.Map((const std::pair<int8_t, int8_t> *)section(DEG_SEC_RANGES), header.range_num);
+            g.active_lo.Map((const uint64_t *)section(DEG_SEC_ACTIVE_LO), header.edge_num);
+            g.active_hi.Map((const uint64_t *)section(DEG_SEC_ACTIVE_HI), header.edge_num);
+            g.locs.Map((const float *)section(DEG_SEC_LOCS), header.section_bytes[DEG_SEC_LOCS] / sizeof(float));
+            // 搜索时不再做边界检查, 这里一次性校验: offsets / range_offsets 从 0 开始单调不减并以边数 / 区间数结尾,
+            // 邻居 id 与入口点都小于 node_num (会读入全部邻接页, 与 mmap_populate 无关)
+            const unsigned *enterpoints = (const unsigned *)section(DEG_SEC_ENTERPOINTS);
+            bool consistent = g.offsets[0] == 0 && g.offsets[header.node_num] == header.edge_num &&
+                              g.range_offsets[0] == 0 && g.range_offsets[header.edge_num] == header.range_num;
+            for (size_t u = 0; u < header.node_num && consistent; u++)
+                consistent = g.offsets[u] <= g.offsets[u + 1];
+            for (size_t e = 0; e < header.edge_num && consistent; e++)
+                consistent = g.range_offsets[e] <= g.range_offsets[e + 1] && g.ids[e] < header.node_num;
+            for (size_t i = 0; i < header.enterpoint_num && consistent; i++)
+                consistent = enterpoints[i] < header.node_num;
+            if (!consistent)
+            {
+                std::cerr << "corrupted DEG index: " << graph_file << std::endl;
+                exit(-1);
+            }
+            enterpoint_set.assign(enterpoints, enterpoints + header.enterpoint_num);
+            if (copy)
+            {
+                DEGSearchGraph owned = g;
+                owned.mapping.reset();
+                std::swap(g, owned);
+            }
+            return true;
+        }
+
         DEGNode *DEG_enterpoint_ = nullptr;
         std::vector<DEGNode *> DEG_nodes_;
+        DEGSearchGraph DEG_search_graph_;
         std::vector<DEGNode *> DEG_enterpoints;
         std::vector<DEGNNDescentNeighbor> DEG_enterpoints_skyeline;
 
@@ -1080,6 +1552,14 @@ namespace stkq
         {
             delete e_dist_;
             delete s_dist_;
+            for (auto *ctx : search_context_pool_)
+                delete ctx;
+            for (auto &replica : numa_replicas_)
+            {
+                FreeAlignedStorage(replica.emb);
+                FreeAlignedStorage(replica.emb_half);
+                FreeAlignedStorage(replica.loc);
+            }
         }
 
         struct SimpleNeighbor
@@ -1131,12 +1611,124 @@ namespace stkq
 
             inline unsigned int GetVisitMark() { return mark_; }
 
+            inline unsigned int GetSize() const { return size_; }
+
         private:
             unsigned int *visited_;
             unsigned int size_;
             unsigned int mark_;
         };
 
+        // 单个查询的只读参数, 由调用方构造后直接传入 route / entry, 搜索过程中不读写 Index 的 Parameters
+        struct SearchRequest
+        {
+            const float *query_emb = nullptr; // 查询的 embedding 向量
+            const float *query_loc = nullptr; // 查询的空间坐标
+            float alpha = 0.5;                // embedding 距离的权重
+            unsigned K = 10;                  // 返回的近邻数量
+            unsigned L = 10;                  // 候选集大小 (ef_search)
+            unsigned budget = 0;              // 距离计算次数上限, 0 表示不限制
+            unsigned prefetch_distance = 0;   // 提前预取向量的邻居个数, 0 表示不预取
+            bool sq8 = false;                 // 用 SQ8 编码遍历, 最终候选集再用浮点距离重排 (仅 DEG)
+            bool pq = false;                  // 用 PQ 编码的 ADC 距离遍历, 最终候选集再用浮点距离重排 (仅 DEG)
+            bool sign_filter = false;         // 计算 embedding 距离前先用符号码估计并剪枝 (仅 DEG)
+            bool emb_aligned = false;         // query 与每行 base embedding 均 64 字节对齐, 可用对齐读取的 kernel
+            bool compressed_graph = false;    // 遍历压缩邻接表 (见 BuildCompressedAdjacency) 而不是 CSR 搜索图 (仅 DEG)
+            unsigned disk_beam_width = 0;     // SSD 模式每轮批量读取的节点块数 (见 OpenDiskIndex), 0 表示内存搜索 (仅 DEG)
+        };
+
+        // 按距离升序排列的查询结果
+        struct SearchResult
+        {
+            std::vector<unsigned> ids;
+            std::vector<float> distances;
+        };
+
+        // 可复用底层存储的优先队列, clear() 只清空元素而保留已分配的容量
+        template <typename T>
+        class SearchQueue : public std::priority_queue<T>
+        {
+        public:
+            inline void clear() { this->c.clear(); }
+        };
+
+        // NUMA 放置策略, 见 PlaceSearchData
+        enum NumaMode
+        {
+            NUMA_OFF = 0,
+            NUMA_INTERLEAVE, // 只读搜索数据按页交错分布在所有节点上
+            NUMA_REPLICATE   // 每个节点一份搜索数据副本, 搜索线程绑定节点并只读本地副本
+        };
+
+        // DEG 搜索路径读取的只读数据, 默认指向 Index 自身的存储, replicate 模式下指向线程所在节点的副本
+        struct SearchData
+        {
+            int node = -1;                      // 副本所在的 NUMA 节点, -1 表示 Index 自身的存储
+            const float *emb = nullptr;         // float base embedding, 半精度存储时为 nullptr
+            const uint16_t *emb_half = nullptr; // fp16 / bf16 base embedding
+            const float *loc = nullptr;
+            const DEGSearchGraph *graph = nullptr;
+        };
+
+        // 单个搜索线程的工作区, 由 AcquireSearchContext 取出并在多个查询之间复用,
+        // 避免每个查询都分配并清零 O(N) 的 visited 数组以及各类候选/结果队列
+        class SearchContext
+        {
+        public:
+            explicit SearchContext(unsigned size) : visited_list(size) {}
+
+            SearchContext(const SearchContext &) = delete;
+            SearchContext &operator=(const SearchContext &) = delete;
+
+            VisitedList visited_list;   // epoch 计数清空, 只在 mark_ 回绕时 memset
+            std::vector<Neighbor> pool; // search entry / greedy route 的候选池
+
+            // HNSW / NSW
+            std::vector<std::pair<HnswNode *, float>> hnsw_path;
+            SearchQueue<FurtherFirst> hnsw_result;
+            SearchQueue<CloserFirst> hnsw_candidates;
+            SearchQueue<CloserFirst> hnsw_sorted;
+
+            // baseline4
+            std::vector<std::pair<BS4Node *, float>> bs4_path;
+            SearchQueue<BS4FurtherFirst> bs4_result;
+            SearchQueue<BS4CloserFirst> bs4_candidates;
+            SearchQueue<BS4CloserFirst> bs4_sorted;
+
+            // DEG
+            SearchData data;                // 本线程读取的搜索数据, AcquireSearchContext 时按线程所在节点设置
+            unsigned fresh_ids[64];         // 当前 64 条边中未访问的有效邻居
+            unsigned fresh_edges[64];       // fresh_ids 对应的边下标, 用于读取内联坐标
+            float fresh_loc_dist[64];       // fresh_ids 对应的空间距离
+            std::vector<unsigned> adjacency_ids; // 从压缩邻接表解码出的有效邻居
+            std::unique_ptr<char, decltype(&free)> disk_blocks{nullptr, &free}; // SSD 模式一轮读取的节点块, 4096 字节对齐
+            unsigned disk_block_num = 0;         // disk_blocks 可容纳的块数
+            std::vector<unsigned> disk_ids;      // 本轮读取的节点
+            std::vector<Neighbor> disk_expanded; // 已读取的节点及其精确混合距离, 最终结果从中取出
+            std::vector<uint8_t> query_code; // SQ8 量化后的 query embedding
+            std::vector<float> pq_table;     // query 到 PQ 各段中心的平方距离表, M * 256
+            std::vector<uint64_t> query_sign; // query embedding 的符号码
+            float query_sign_norm = 0;        // 中心化后 query embedding 的范数
+            std::vector<Neighbor> deg_pool; // 按混合距离升序的定长候选集, 容量 L + 1
+
+            // 线程本地计数, ReleaseSearchContext 时汇总到 Index
+            unsigned dist_count = 0;
+            unsigned hop_count = 0;
+            size_t dim_count = 0; // 实际扫描的 embedding 维数, 提前终止的距离只计已扫描部分
+            unsigned sign_filtered = 0; // 被符号码预筛跳过的 embedding 距离次数
+
+            // 记录当前查询开始时的距离计算次数, 用于检查 SearchRequest::budget
+            inline void BeginQuery() { query_dist_begin = dist_count; }
+
+            inline bool OverBudget(const SearchRequest &req) const
+            {
+                return req.budget != 0 && dist_count - query_dist_begin >= req.budget;
+            }
+
+        private:
+            unsigned query_dist_begin = 0;
+        };
+
         static inline int InsertIntoPool(Neighbor *addr, unsigned K, Neighbor nn)
         {
             // find the location to insert
@@ -1178,6 +1770,22 @@ namespace stkq
             return right;
         }
 
+        // 向当前有 size 个点、容量为 L 的有序候选集插入 nn, 超出 L 的最远点被挤出
+        // addr 需预留 L + 1 个位置, 返回插入位置
+        static inline int InsertIntoBoundedPool(Neighbor *addr, unsigned &size, unsigned L, Neighbor nn)
+        {
+            if (size == 0)
+            {
+                addr[0] = nn;
+                size = 1;
+                return 0;
+            }
+            int r = InsertIntoPool(addr, size, nn);
+            if (r <= (int)size && size < L)
+                size++;
+            return r;
+        }
+
         float *getBaseEmbData() const
         {
             return base_emb_data_;
@@ -1188,6 +1796,38 @@ namespace stkq
             base_emb_data_ = baseEmbData;
         }
 
+        // 把 base embedding 转为 fp16 / bf16 保存并释放 float 数据, 之后 getBaseEmbData() 为 nullptr,
+        // 只有 DEG 搜索路径支持半精度 embedding; huge_pages 时在写入前对新存储建议透明大页
+        void ConvertBaseEmbToHalf(EmbPrecision precision, bool huge_pages = false)
+        {
+            emb_precision_ = precision;
+            base_emb_half_.reserve((size_t)base_len_ * base_emb_dim_);
+            if (huge_pages)
+                AdviseHugePages(base_emb_half_.data(), base_emb_half_.capacity() * sizeof(uint16_t));
+            base_emb_half_.resize((size_t)base_len_ * base_emb_dim_);
+            ConvertFloatToHalf(base_emb_data_, base_emb_half_.data(), base_emb_half_.size(), precision);
+            FreeAlignedStorage(base_emb_data_);
+            base_emb_data_ = nullptr;
+        }
+
+        // base embedding 起点与行长 (dim * 4 字节) 都是 64 的倍数时, 每一行都按 cache line 对齐;
+        // 行不做填充, 维数不是 16 的倍数时使用非对齐读取的 kernel
+        bool IsBaseEmbRowAligned() const
+        {
+            return base_emb_data_ != nullptr && (uintptr_t)base_emb_data_ % kStorageAlign == 0 &&
+                   base_emb_dim_ * sizeof(float) % kStorageAlign == 0;
+        }
+
+        EmbPrecision getEmbPrecision() const
+        {
+            return emb_precision_;
+        }
+
+        inline const uint16_t *getBaseEmbHalf(unsigned id) const
+        {
+            return base_emb_half_.data() + (size_t)id * base_emb_dim_;
+        }
+
         float *getBaseLocData() const
         {
             return base_loc_data_;
@@ -1460,7 +2100,7 @@ namespace stkq
 
         unsigned int getDistCount() const
         {
-            return dist_count;
+            return dist_count.load(std::memory_order_relaxed);
         }
 
         void resetDistCount()
@@ -1470,12 +2110,12 @@ namespace stkq
 
         void addDistCount()
         {
-            dist_count += 1;
+            dist_count.fetch_add(1, std::memory_order_relaxed);
         }
 
         unsigned int getHopCount() const
         {
-            return hop_count;
+            return hop_count.load(std::memory_order_relaxed);
         }
 
         void resetHopCount()
@@ -1485,7 +2125,765 @@ namespace stkq
 
         void addHopCount()
         {
-            hop_count += 1;
+            hop_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t getDimCount() const
+        {
+            return dim_count.load(std::memory_order_relaxed);
+        }
+
+        void resetDimCount()
+        {
+            dim_count = 0;
+        }
+
+        unsigned getSignFilteredCount() const
+        {
+            return sign_filtered_count.load(std::memory_order_relaxed);
+        }
+
+        void resetSignFilteredCount()
+        {
+            sign_filtered_count = 0;
+        }
+
+        // 索引从文件加载后只读, 搜索时无需对节点加锁
+        bool isFrozen() const
+        {
+            return frozen_;
+        }
+
+        void setFrozen(bool frozen)
+        {
+            frozen_ = frozen;
+        }
+
+        // 提前把第 id 个 base 对象的 embedding 与空间向量读入 cache,
+        // embedding 只预取开头 PREFETCH_EMB_BYTES, 之后的顺序部分交给硬件预取
+        static constexpr unsigned PREFETCH_EMB_BYTES = 256;
+
+        inline void PrefetchBaseData(unsigned id, bool sq8 = false, bool pq = false, bool loc = true) const
+        {
+            SearchData data;
+            data.emb = base_emb_data_;
+            data.emb_half = base_emb_half_.data();
+            data.loc = base_loc_data_;
+            PrefetchBaseData(data, id, sq8, pq, loc);
+        }
+
+        // 同上, embedding 与坐标从 data (可能是 NUMA 副本) 中读取
+        inline void PrefetchBaseData(const SearchData &data, unsigned id, bool sq8, bool pq, bool loc) const
+        {
+            const char *emb = (const char *)(data.emb + (size_t)id * base_emb_dim_);
+            unsigned emb_bytes = base_emb_dim_ * sizeof(float);
+            if (emb_precision_ != EMB_FLOAT32)
+            {
+                emb = (const char *)(data.emb_half + (size_t)id * base_emb_dim_);
+                emb_bytes = base_emb_dim_ * sizeof(uint16_t);
+            }
+            if (pq)
+            {
+                emb = (const char *)getPQCode(id);
+                emb_bytes = pq_.M();
+            }
+            else if (sq8)
+            {
+                emb = (const char *)getSQ8Code(id);
+                emb_bytes = base_emb_dim_;
+            }
+            emb_bytes = std::min(emb_bytes, PREFETCH_EMB_BYTES);
+            for (unsigned off = 0; off < emb_bytes; off += 64)
+                _mm_prefetch(emb + off, _MM_HINT_T0);
+            if (loc)
+                _mm_prefetch((const char *)(data.loc + (size_t)id * base_loc_dim_), _MM_HINT_T0);
+        }
+
+        // 一对多混合距离: query 到 ids[0..n) 各点的 embedding 距离 e_d 与空间距离 s_d,
+        // d 非空时同时写入 alpha * e_d + (1 - alpha) * s_d
+        inline void HybridDistanceBatch(const float *query_emb, const float *query_loc, float alpha,
+                                        const unsigned *ids, unsigned n, float *e_d, float *s_d, float *d = nullptr) const
+        {
+            s_dist_->compare_batch(base_loc_data_, base_loc_dim_, query_loc, ids, n, s_d);
+            e_dist_->compare_batch(base_emb_data_, base_emb_dim_, query_emb, ids, n, e_d);
+            if (d != nullptr)
+            {
+                for (unsigned i = 0; i < n; i++)
+                    d[i] = alpha * e_d[i] + (1 - alpha) * s_d[i];
+            }
+        }
+
+        // SQ8: 每一维减去该维最小值后按统一步长量化为 uint8, 各维共用步长使编码差值与浮点差值成正比,
+        // 遍历时可直接用整数 kernel 计算距离; 原始浮点数据保留用于最终重排
+        void BuildSQ8()
+        {
+            const unsigned dim = base_emb_dim_;
+            sq8_min_.assign(dim, FLT_MAX);
+            std::vector<float> max_value(dim, -FLT_MAX);
+            for (size_t i = 0; i < base_len_; i++)
+            {
+                const float *x = base_emb_data_ + i * dim;
+                for (unsigned d = 0; d < dim; d++)
+                {
+                    sq8_min_[d] = std::min(sq8_min_[d], x[d]);
+                    max_value[d] = std::max(max_value[d], x[d]);
+                }
+            }
+            float range = 0;
+            for (unsigned d = 0; d < dim; d++)
+                range = std::max(range, max_value[d] - sq8_min_[d]);
+            sq8_step_ = range > 0 ? range / 255 : 1;
+
+            sq8_codes_.resize((size_t)base_len_ * dim);
+#pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < base_len_; i++)
+                EncodeSQ8(base_emb_data_ + i * dim, sq8_codes_.data() + i * dim);
+        }
+
+        inline void EncodeSQ8(const float *x, uint8_t *code) const
+        {
+            for (unsigned d = 0; d < base_emb_dim_; d++)
+            {
+                float v = std::round((x[d] - sq8_min_[d]) / sq8_step_);
+                code[d] = (uint8_t)std::min(255.0f, std::max(0.0f, v));
+            }
+        }
+
+        bool hasSQ8() const
+        {
+            return !sq8_codes_.empty();
+        }
+
+        inline const uint8_t *getSQ8Code(unsigned id) const
+        {
+            return sq8_codes_.data() + (size_t)id * base_emb_dim_;
+        }
+
+        float getSQ8Step() const
+        {
+            return sq8_step_;
+        }
+
+        // 由当前 (加载 / 重排后的) CSR 搜索图生成压缩邻接表, 与 CSR 图并存, 由 SearchRequest::compressed_graph 选择;
+        // NUMA replicate 模式下与 SQ8 / PQ 编码一样只有一份
+        void BuildCompressedAdjacency()
+        {
+            const DEGSearchGraph &g = DEG_search_graph_;
+            compressed_adjacency_.Build(g.size(), g.offsets.data(), g.ids.data(), g.range_offsets.data(), g.ranges.data());
+        }
+
+        // SSD 模式: 打开 file 处的磁盘索引, 文件不存在或与当前 CSR 搜索图不一致时先由 float embedding 与搜索图写出;
+        // 打开后释放内存中的 float embedding 与 CSR 搜索图, 只保留坐标、入口点与 SQ8 / PQ 编码 (需在此之前生成),
+        // 扩展节点时从磁盘块读取邻接记录, 并用块中的 embedding 计算精确距离. 返回是否重新写出了文件
+        bool OpenDiskIndex(const char *file, bool direct, unsigned io_threads)
+        {
+            const DEGSearchGraph &g = DEG_search_graph_;
+            const uint64_t hash = DiskIndex::GraphHash(g.size(), g.offsets.data(), g.ids.data());
+            bool written = false;
+            if (!disk_index_.Open(file, base_len_, base_emb_dim_, hash, direct, io_threads))
+            {
+                if (base_emb_data_ == nullptr || g.size() != base_len_)
+                {
+                    std::cerr << "disk index requires float embeddings and the DEG search graph: " << file << std::endl;
+                    exit(-1);
+                }
+                DiskIndex::Write(file, base_len_, base_emb_data_, base_emb_dim_, g.offsets.data(), g.ids.data(),
+                                 g.range_offsets.data(), g.ranges.data());
+                written = true;
+                if (!disk_index_.Open(file, base_len_, base_emb_dim_, hash, direct, io_threads))
+                {
+                    std::cerr << "open disk index error: " << file << std::endl;
+                    exit(-1);
+                }
+            }
+            FreeAlignedStorage(base_emb_data_);
+            base_emb_data_ = nullptr;
+            DEG_search_graph_.clear();
+            compressed_adjacency_ = CompressedAdjacency();
+            return written;
+        }
+
+        bool hasDiskIndex() const
+        {
+            return disk_index_.opened();
+        }
+
+        const DiskIndex &getDiskIndex() const
+        {
+            return disk_index_;
+        }
+
+        // SSD 模式下常驻内存的数据 (坐标、SQ8 / PQ 编码) 每个节点的字节数
+        double DiskResidentBytesPerNode() const
+        {
+            const size_t bytes = (size_t)base_len_ * base_loc_dim_ * sizeof(float) + sq8_codes_.size() +
+                                 sq8_min_.size() * sizeof(float) + pq_codes_.size();
+            return (double)bytes / std::max<unsigned>(base_len_, 1);
+        }
+
+        bool hasCompressedAdjacency() const
+        {
+            return !compressed_adjacency_.empty();
+        }
+
+        const CompressedAdjacency &getCompressedAdjacency() const
+        {
+            return compressed_adjacency_;
+        }
+
+        // PQ: 在 sample 个随机 base embedding 上训练 M 段码本, 再把全部 base 编码为 M 字节
+        void BuildPQ(unsigned M, size_t sample, unsigned iters)
+        {
+            pq_.Train(base_emb_data_, base_len_, base_emb_dim_, M, sample, iters);
+            pq_codes_.resize((size_t)base_len_ * M);
+            pq_.Encode(base_emb_data_, base_len_, pq_codes_.data());
+        }
+
+        // 码本与编码一起保存, 格式: PQCodec, base 数量, base 数量 * M 字节的编码
+        void SavePQ(const char *filename) const
+        {
+            std::ofstream out(filename, std::ios::binary | std::ios::out);
+            if (!out.is_open())
+            {
+                std::cerr << "cannot open pq file: " << filename << std::endl;
+                exit(-1);
+            }
+            pq_.Save(out);
+            const unsigned n = base_len_;
+            out.write((char *)&n, sizeof(unsigned));
+            out.write((char *)pq_codes_.data(), pq_codes_.size());
+        }
+
+        // 文件不存在或与当前 base 数据 / M 不一致时返回 false, 此时需重新 BuildPQ
+        bool LoadPQ(const char *filename, unsigned M)
+        {
+            std::ifstream in(filename, std::ios::binary | std::ios::in);
+            if (!in.is_open())
+                return false;
+            PQCodec pq;
+            unsigned n = 0;
+            if (!pq.Load(in) || pq.dim() != base_emb_dim_ || pq.M() != M)
+                return false;
+            in.read((char *)&n, sizeof(unsigned));
+            if (!in || n != base_len_)
+                return false;
+            std::vector<uint8_t> codes((size_t)n * M);
+            in.read((char *)codes.data(), codes.size());
+            if (!in)
+                return false;
+            pq_ = pq;
+            pq_codes_.swap(codes);
+            return true;
+        }
+
+        bool hasPQ() const
+        {
+            return !pq_codes_.empty();
+        }
+
+        const PQCodec &getPQ() const
+        {
+            return pq_;
+        }
+
+        inline const uint8_t *getPQCode(unsigned id) const
+        {
+            return pq_codes_.data() + (size_t)id * pq_.M();
+        }
+
+        // 符号码: 每一维减去均值后取符号, 每个对象占 sign_words_ 个 uint64, 连续存放.
+        // 中心化后两个向量的夹角约为 pi * hamming / dim, 结合两者范数即可估计平方距离:
+        // |x - y|^2 = |x|^2 + |y|^2 - 2 |x| |y| cos(theta)
+        void BuildSignCodes()
+        {
+            const unsigned dim = base_emb_dim_;
+            std::vector<double> sum(dim, 0);
+            for (size_t i = 0; i < base_len_; i++)
+            {
+                const float *x = base_emb_data_ + i * dim;
+                for (unsigned d = 0; d < dim; d++)
+                    sum[d] += x[d];
+            }
+            sign_mean_.resize(dim);
+            for (unsigned d = 0; d < dim; d++)
+                sign_mean_[d] = (float)(sum[d] / base_len_);
+            sign_cos_.resize(dim + 1);
+            for (unsigned h = 0; h <= dim; h++)
+                sign_cos_[h] = (float)std::cos(M_PI * h / dim);
+
+            sign_words_ = (dim + 63) / 64;
+            sign_codes_.assign((size_t)base_len_ * sign_words_, 0);
+            sign_norms_.resize(base_len_);
+#pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < base_len_; i++)
+                EncodeSign(base_emb_data_ + i * dim, sign_codes_.data() + i * sign_words_, sign_norms_[i]);
+        }
+
+        inline void EncodeSign(const float *x, uint64_t *code, float &norm) const
+        {
+            float sqr = 0;
+            std::fill(code, code + sign_words_, 0);
+            for (unsigned d = 0; d < base_emb_dim_; d++)
+            {
+                const float v = x[d] - sign_mean_[d];
+                sqr += v * v;
+                if (v > 0)
+                    code[d >> 6] |= (uint64_t)1 << (d & 63);
+            }
+            norm = std::sqrt(sqr);
+        }
+
+        // 由符号码估计的 embedding 平方距离 (未归一化)
+        inline float EstimateEmbSqrDist(const uint64_t *query_code, float query_norm, unsigned id) const
+        {
+            const uint32_t h = e_dist_->kernels().hamming(query_code, getSignCode(id), sign_words_);
+            const float norm = sign_norms_[id];
+            return query_norm * query_norm + norm * norm - 2 * query_norm * norm * sign_cos_[h];
+        }
+
+        // 校准: 随机取 sample 个点, 每个点与 2000 个随机点中最近的 20 个组成近距离点对,
+        // 统计 真实平方距离 / 估计平方距离 的分布并取 quantile 分位数作为保守系数;
+        // 搜索时估计值乘以该系数仍超过阈值的候选点才会被跳过
+        void CalibrateSignFilter(float quantile, unsigned sample)
+        {
+            const unsigned candidates = std::min<unsigned>(2000, base_len_ - 1);
+            const unsigned nearest = std::min<unsigned>(20, candidates);
+            std::mt19937 rng(2024);
+            std::vector<float> ratios;
+            std::vector<std::pair<float, unsigned>> dist(candidates);
+            for (unsigned s = 0; s < sample; s++)
+            {
+                const unsigned u = rng() % base_len_;
+                const float *x = base_emb_data_ + (size_t)u * base_emb_dim_;
+                for (unsigned c = 0; c < candidates; c++)
+                {
+                    unsigned v = rng() % base_len_;
+                    if (v == u)
+                        v = (v + 1) % base_len_;
+                    dist[c] = std::make_pair(e_dist_->kernels().sqr_dist(x, base_emb_data_ + (size_t)v * base_emb_dim_, base_emb_dim_), v);
+                }
+                std::partial_sort(dist.begin(), dist.begin() + nearest, dist.end());
+                for (unsigned c = 0; c < nearest; c++)
+                {
+                    const float est = EstimateEmbSqrDist(getSignCode(u), sign_norms_[u], dist[c].second);
+                    if (est > 0)
+                        ratios.push_back(dist[c].first / est);
+                }
+            }
+            if (ratios.empty())
+            {
+                sign_ratio_ = 0; // 无法校准时不剪枝
+                return;
+            }
+            const size_t pos = std::min(ratios.size() - 1, (size_t)(quantile * ratios.size()));
+            std::nth_element(ratios.begin(), ratios.begin() + pos, ratios.end());
+            sign_ratio_ = ratios[pos];
+        }
+
+        bool hasSignCodes() const
+        {
+            return !sign_codes_.empty();
+        }
+
+        inline const uint64_t *getSignCode(unsigned id) const
+        {
+            return sign_codes_.data() + (size_t)id * sign_words_;
+        }
+
+        unsigned getSignWords() const
+        {
+            return sign_words_;
+        }
+
+        float getSignRatio() const
+        {
+            return sign_ratio_;
+        }
+
+        // 按 perm 重排每行 row 个元素的数组: 新的第 i 行为原来的第 perm[i] 行, 沿置换环原地交换, 只需一行的临时空间
+        template <typename T>
+        static void PermuteRows(T *data, size_t row, const std::vector<unsigned> &perm)
+        {
+            if (data == nullptr || row == 0)
+                return;
+            std::vector<T> tmp(row);
+            std::vector<bool> done(perm.size(), false);
+            for (size_t i = 0; i < perm.size(); i++)
+            {
+                if (done[i] || perm[i] == i)
+                    continue;
+                std::copy(data + i * row, data + (i + 1) * row, tmp.begin());
+                size_t j = i;
+                while (true)
+                {
+                    done[j] = true;
+                    const size_t k = perm[j];
+                    if (k == i)
+                    {
+                        std::copy(tmp.begin(), tmp.end(), data + j * row);
+                        break;
+                    }
+                    std::copy(data + k * row, data + (k + 1) * row, data + j * row);
+                    j = k;
+                }
+            }
+        }
+
+        // 按 perm 重排 base 数据及由其导出的各类编码, 新 id i 对应当前 id perm[i]
+        void PermuteBaseData(const std::vector<unsigned> &perm)
+        {
+            PermuteRows(base_emb_data_, base_emb_dim_, perm);
+            PermuteRows(base_emb_half_.empty() ? nullptr : base_emb_half_.data(), base_emb_dim_, perm);
+            PermuteRows(base_loc_data_, base_loc_dim_, perm);
+            PermuteRows(sign_codes_.empty() ? nullptr : sign_codes_.data(), sign_words_, perm);
+            PermuteRows(sign_norms_.empty() ? nullptr : sign_norms_.data(), 1, perm);
+            PermuteRows(sq8_codes_.empty() ? nullptr : sq8_codes_.data(), base_emb_dim_, perm);
+            PermuteRows(pq_codes_.empty() ? nullptr : pq_codes_.data(), pq_.M(), perm);
+        }
+
+        // 局部性重排: 计算新的节点顺序 perm (新 id i 对应当前 id perm[i]), 使图上相邻的点在 base 数组中也相邻
+        //   bfs:     从入口点集合出发广度优先遍历
+        //   rcm:     reverse Cuthill-McKee, 每个连通块从度最小的点开始, 邻居按度升序访问, 最后整体反转
+        //   hilbert: 按空间坐标的 Hilbert 曲线序, 只用于二维坐标
+        std::vector<unsigned> ComputeDEGOrder(const std::string &method) const
+        {
+            const DEGSearchGraph &g = DEG_search_graph_;
+            const unsigned n = base_len_;
+            std::vector<unsigned> perm;
+            perm.reserve(n);
+            if (method == "hilbert")
+            {
+                if (base_loc_dim_ != 2)
+                {
+                    std::cerr << "hilbert reordering requires 2-D locations" << std::endl;
+                    exit(-1);
+                }
+                float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+                for (unsigned i = 0; i < n; i++)
+                {
+                    min_x = std::min(min_x, base_loc_data_[2 * i]);
+                    max_x = std::max(max_x, base_loc_data_[2 * i]);
+                    min_y = std::min(min_y, base_loc_data_[2 * i + 1]);
+                    max_y = std::max(max_y, base_loc_data_[2 * i + 1]);
+                }
+                const unsigned side = 1u << 16;
+                std::vector<std::pair<uint64_t, unsigned>> keys(n);
+                for (unsigned i = 0; i < n; i++)
+                {
+                    uint32_t x = (uint32_t)((base_loc_data_[2 * i] - min_x) / std::max(max_x - min_x, FLT_MIN) * (side - 1));
+                    uint32_t y = (uint32_t)((base_loc_data_[2 * i + 1] - min_y) / std::max(max_y - min_y, FLT_MIN) * (side - 1));
+                    // 经典的 xy -> d 转换
+                    uint64_t d = 0;
+                    for (uint32_t sd = side / 2; sd > 0; sd /= 2)
+                    {
+                        const uint32_t rx = (x & sd) > 0, ry = (y & sd) > 0;
+                        d += (uint64_t)sd * sd * ((3 * rx) ^ ry);
+                        if (ry == 0)
+                        {
+                            if (rx == 1)
+                            {
+                                x = side - 1 - x;
+                                y = side - 1 - y;
+                            }
+                            std::swap(x, y);
+                        }
+                    }
+                    keys[i] = std::make_pair(d, i);
+                }
+                std::sort(keys.begin(), keys.end());
+                for (auto &key : keys)
+                    perm.push_back(key.second);
+                return perm;
+            }
+            if (method != "bfs" && method != "rcm")
+            {
+                std::cerr << "unknown reorder method: " << method << std::endl;
+                exit(-1);
+            }
+
+            const bool rcm = method == "rcm";
+            std::vector<bool> visited(n, false);
+            std::vector<unsigned> seeds;
+            if (rcm)
+            {
+                // 度最小的点优先作为新连通块的起点
+                seeds.resize(n);
+                for (unsigned i = 0; i < n; i++)
+                    seeds[i] = i;
+                std::stable_sort(seeds.begin(), seeds.end(), [&g](unsigned a, unsigned b)
+                                 { return g.EdgeEnd(a) - g.EdgeBegin(a) < g.EdgeEnd(b) - g.EdgeBegin(b); });
+            }
+            else
+            {
+                seeds = enterpoint_set;
+                for (unsigned i = 0; i < n; i++)
+                    seeds.push_back(i);
+            }
+            std::vector<unsigned> next;
+            for (unsigned seed : seeds)
+            {
+                if (visited[seed])
+                    continue;
+                size_t head = perm.size();
+                visited[seed] = true;
+                perm.push_back(seed);
+                while (head < perm.size())
+                {
+                    const unsigned u = perm[head++];
+                    next.clear();
+                    for (size_t e = g.EdgeBegin(u); e < g.EdgeEnd(u); e++)
+                    {
+                        const unsigned v = g.ids[e];
+                        if (!visited[v])
+                        {
+                            visited[v] = true;
+                            next.push_back(v);
+                        }
+                    }
+                    if (rcm)
+                        std::stable_sort(next.begin(), next.end(), [&g](unsigned a, unsigned b)
+                                         { return g.EdgeEnd(a) - g.EdgeBegin(a) < g.EdgeEnd(b) - g.EdgeBegin(b); });
+                    perm.insert(perm.end(), next.begin(), next.end());
+                }
+            }
+            if (rcm)
+                std::reverse(perm.begin(), perm.end());
+            return perm;
+        }
+
+        // 把 DEG 搜索图、入口点与 base 数据一起按 perm 重排, 并累积新 id 到原始 id 的映射
+        void ApplyDEGPermutation(const std::vector<unsigned> &perm)
+        {
+            const unsigned n = base_len_;
+            std::vector<unsigned> old_to_new(n);
+            for (unsigned i = 0; i < n; i++)
+                old_to_new[perm[i]] = i;
+
+            const DEGSearchGraph &g = DEG_search_graph_;
+            DEGSearchGraph permuted;
+            permuted.reserve(n, g.ids.size());
+            for (unsigned i = 0; i < n; i++)
+            {
+                const unsigned u = perm[i];
+                for (size_t e = g.EdgeBegin(u); e < g.EdgeEnd(u); e++)
+                    permuted.AddEdge(old_to_new[g.ids[e]], g.ranges.data() + g.range_offsets[e],
+                                     g.range_offsets[e + 1] - g.range_offsets[e]);
+                permuted.FinishNode();
+            }
+            for (auto &ep : enterpoint_set)
+                ep = old_to_new[ep];
+
+            PermuteBaseData(perm);
+            permuted.BuildActiveMasks();
+            permuted.BuildInlineLocs(base_loc_data_, base_loc_dim_);
+            std::swap(DEG_search_graph_, permuted);
+            // 压缩邻接表按旧的 id 编码, 需要时重新生成
+            compressed_adjacency_ = CompressedAdjacency();
+
+            if (new_to_old_.empty())
+                new_to_old_ = perm;
+            else
+            {
+                std::vector<unsigned> composed(n);
+                for (unsigned i = 0; i < n; i++)
+                    composed[i] = new_to_old_[perm[i]];
+                new_to_old_.swap(composed);
+            }
+        }
+
+        // 加载已重排的索引时, 原始顺序的 base 数据按保存的映射重排, 之后内部 id i 对应原始 id new_to_old[i]
+        void SetDEGPermutation(const std::vector<unsigned> &new_to_old)
+        {
+            new_to_old_ = new_to_old;
+            PermuteBaseData(new_to_old_);
+        }
+
+        bool hasPermutation() const
+        {
+            return !new_to_old_.empty();
+        }
+
+        const std::vector<unsigned> &getPermutation() const
+        {
+            return new_to_old_;
+        }
+
+        // 内部 id 转为原始 (输入文件中的) id, 在返回查询结果时调用
+        inline unsigned getExternalId(unsigned id) const
+        {
+            return new_to_old_.empty() ? id : new_to_old_[id];
+        }
+
+        // 为第 query 个查询构造 SearchRequest, 只填写查询本身与 K / L;
+        // 预算、预取与各搜索模式的字段由调用方在返回值上按名字设置 (如 req.sq8 = true)
+        SearchRequest MakeSearchRequest(unsigned query, float alpha, unsigned K, unsigned L) const
+        {
+            SearchRequest req;
+            req.query_emb = query_emb_data_ + (size_t)query * base_emb_dim_;
+            req.query_loc = query_loc_data_ + (size_t)query * base_loc_dim_;
+            req.alpha = alpha;
+            req.K = K;
+            req.L = L;
+            req.emb_aligned = IsBaseEmbRowAligned() && (uintptr_t)req.query_emb % kStorageAlign == 0;
+            return req;
+        }
+
+        // 取出一个空闲的 SearchContext, 池为空或 base 数据规模变化时新建
+        SearchContext *AcquireSearchContext()
+        {
+            SearchContext *ctx = nullptr;
+            {
+                LockGuard guard(search_context_lock_);
+                if (!search_context_pool_.empty())
+                {
+                    ctx = search_context_pool_.back();
+                    search_context_pool_.pop_back();
+                }
+            }
+            if (ctx != nullptr && ctx->visited_list.GetSize() < base_len_)
+            {
+                delete ctx;
+                ctx = nullptr;
+            }
+            if (ctx == nullptr)
+                ctx = new SearchContext(base_len_);
+            ctx->data = LocalSearchData();
+            return ctx;
+        }
+
+        // 当前线程应读取的搜索数据: 有 NUMA 副本时取线程所在节点的副本, 否则为 Index 自身的存储
+        SearchData LocalSearchData() const
+        {
+            SearchData data;
+            data.emb = base_emb_data_;
+            data.emb_half = base_emb_half_.empty() ? nullptr : base_emb_half_.data();
+            data.loc = base_loc_data_;
+            data.graph = &DEG_search_graph_;
+#ifdef STKQ_NUMA
+            if (!numa_replicas_.empty())
+            {
+                const int cpu = sched_getcpu();
+                const int node = cpu < 0 ? 0 : numa_node_of_cpu(cpu);
+                const NumaReplica *replica = &numa_replicas_[0];
+                for (const auto &r : numa_replicas_)
+                    if (r.node == node)
+                        replica = &r;
+                data.node = replica->node;
+                data.emb = replica->emb;
+                data.emb_half = replica->emb_half;
+                data.loc = replica->loc;
+                data.graph = &replica->graph;
+            }
+#endif
+            return data;
+        }
+
+        // 按 mode 重新放置只读搜索数据 (base embedding / 坐标与 DEG 搜索图), 在加载与重排完成后、搜索前调用一次:
+        // interleave 在交错分配策略下重新复制一遍, 使各页均匀分布到所有节点;
+        // replicate 在每个节点上各启动一个绑定该节点的线程, 由它复制 (首次写入) 一份本地副本.
+        // SQ8 / PQ / 符号码不复制, replicate 模式下这些模式仍读取共享的一份. 返回新增的字节数
+        size_t PlaceSearchData(NumaMode mode)
+        {
+            if (mode == NUMA_OFF || numa_mode_ != NUMA_OFF)
+                return 0;
+#ifdef STKQ_NUMA
+            if (numa_available() < 0)
+            {
+                std::cerr << "numa is not available on this system" << std::endl;
+                exit(-1);
+            }
+            numa_nodes_.clear();
+            for (int node = 0; node <= numa_max_node(); node++)
+                if (numa_bitmask_isbitset(numa_all_nodes_ptr, node))
+                    numa_nodes_.push_back(node);
+            numa_mode_ = mode;
+            const size_t emb_len = (size_t)base_len_ * base_emb_dim_, loc_len = (size_t)base_len_ * base_loc_dim_;
+            if (mode == NUMA_INTERLEAVE)
+            {
+                numa_set_interleave_mask(numa_all_nodes_ptr);
+                if (base_emb_data_ != nullptr)
+                {
+                    float *emb = CopyToLocalStorage(base_emb_data_, emb_len);
+                    FreeAlignedStorage(base_emb_data_);
+                    base_emb_data_ = emb;
+                }
+                std::vector<uint16_t>(base_emb_half_).swap(base_emb_half_);
+                float *loc = CopyToLocalStorage(base_loc_data_, loc_len);
+                FreeAlignedStorage(base_loc_data_);
+                base_loc_data_ = loc;
+                DEGSearchGraph graph = DEG_search_graph_;
+                std::swap(DEG_search_graph_, graph);
+                std::vector<uint8_t>(sq8_codes_).swap(sq8_codes_);
+                std::vector<uint8_t>(pq_codes_).swap(pq_codes_);
+                std::vector<uint64_t>(sign_codes_).swap(sign_codes_);
+                numa_set_localalloc();
+                return 0;
+            }
+            numa_replicas_.resize(numa_nodes_.size());
+            for (size_t r = 0; r < numa_nodes_.size(); r++)
+            {
+                NumaReplica &replica = numa_replicas_[r];
+                replica.node = numa_nodes_[r];
+                std::thread([&]()
+                            {
+                                numa_run_on_node(replica.node);
+                                numa_set_localalloc();
+                                if (base_emb_data_ != nullptr)
+                                    replica.emb = CopyToLocalStorage(base_emb_data_, emb_len);
+                                if (!base_emb_half_.empty())
+                                    replica.emb_half = CopyToLocalStorage(base_emb_half_.data(), emb_len);
+                                replica.loc = CopyToLocalStorage(base_loc_data_, loc_len);
+                                replica.graph = DEG_search_graph_; })
+                    .join();
+            }
+            return numa_replicas_.size() * SearchDataBytes();
+#else
+            std::cerr << "built without libnuma, numa placement is not available" << std::endl;
+            exit(-1);
+#endif
+        }
+
+        // 一份只读搜索数据 (embedding, 坐标, DEG 搜索图) 占用的字节数
+        size_t SearchDataBytes() const
+        {
+            const DEGSearchGraph &g = DEG_search_graph_;
+            return (size_t)base_len_ * base_emb_dim_ * (emb_precision_ == EMB_FLOAT32 ? sizeof(float) : sizeof(uint16_t)) +
+                   (size_t)base_len_ * base_loc_dim_ * sizeof(float) + g.Bytes();
+        }
+
+        // 把第 thread 个搜索线程绑定到第 thread % 节点数 个 NUMA 节点, 未启用 NUMA 放置时不做任何事;
+        // 在 AcquireSearchContext 之前调用, 使 SearchContext 取到本节点的副本
+        void PinSearchThread(unsigned thread) const
+        {
+#ifdef STKQ_NUMA
+            if (numa_mode_ != NUMA_OFF && !numa_nodes_.empty())
+                numa_run_on_node(numa_nodes_[thread % numa_nodes_.size()]);
+#endif
+        }
+
+        NumaMode getNumaMode() const
+        {
+            return numa_mode_;
+        }
+
+        const std::vector<int> &getNumaNodes() const
+        {
+            return numa_nodes_;
+        }
+
+        // 归还 SearchContext, 并把其中累计的距离计算 / 跳数计数合并到 Index
+        void ReleaseSearchContext(SearchContext *ctx)
+        {
+            dist_count.fetch_add(ctx->dist_count, std::memory_order_relaxed);
+            hop_count.fetch_add(ctx->hop_count, std::memory_order_relaxed);
+            dim_count.fetch_add(ctx->dim_count, std::memory_order_relaxed);
+            sign_filtered_count.fetch_add(ctx->sign_filtered, std::memory_order_relaxed);
+            ctx->dist_count = 0;
+            ctx->hop_count = 0;
+            ctx->dim_count = 0;
+            ctx->sign_filtered = 0;
+            LockGuard guard(search_context_lock_);
+            search_context_pool_.push_back(ctx);
         }
 
         void setNumThreads(const unsigned numthreads)
@@ -1512,6 +2910,28 @@ namespace stkq
         E_Distance *e_dist_;
         E_Distance *s_dist_;
 
+        EmbPrecision emb_precision_ = EMB_FLOAT32; // base embedding 的存储精度
+        std::vector<uint16_t> base_emb_half_;      // fp16 / bf16 存储时的 base embedding, 此时 base_emb_data_ 已释放
+
+        std::vector<uint8_t> sq8_codes_; // base embedding 的 SQ8 编码, 未启用时为空
+        std::vector<float> sq8_min_;     // 每一维的最小值
+        float sq8_step_ = 1;             // 各维共用的量化步长
+
+        std::vector<unsigned> new_to_old_; // 局部性重排后内部 id 到原始 id 的映射, 未重排时为空
+
+        CompressedAdjacency compressed_adjacency_; // DEG 搜索图的压缩邻接表, 未启用时为空
+        DiskIndex disk_index_;                     // SSD 模式的磁盘索引, 未启用时未打开
+
+        unsigned sign_words_ = 0;         // 每个对象符号码的 uint64 个数
+        std::vector<uint64_t> sign_codes_; // base embedding 的符号码, 未启用时为空
+        std::vector<float> sign_norms_;    // 中心化后 base embedding 的范数
+        std::vector<float> sign_mean_;     // 每一维的均值
+        std::vector<float> sign_cos_;      // cos(pi * h / dim), h = 0..dim
+        float sign_ratio_ = 0;             // 校准得到的 真实 / 估计 平方距离 的保守下界
+
+        PQCodec pq_;                    // PQ 码本, 未启用时 M() == 0
+        std::vector<uint8_t> pq_codes_; // base embedding 的 PQ 编码, 每个点 M 字节
+
         FinalGraph final_graph_;
         LoadGraph load_graph_;
         LoadGraph exact_graph_;
@@ -1523,8 +2943,43 @@ namespace stkq
 
         RTreeIndex rtree_index;
 
-        unsigned dist_count = 0;
-        unsigned hop_count = 0;
+        // 所有搜索线程共享的计数
+        std::atomic<unsigned> dist_count{0};
+        std::atomic<unsigned> hop_count{0};
+        std::atomic<size_t> dim_count{0};
+        std::atomic<unsigned> sign_filtered_count{0};
+
+        // 由调用线程分配并首次写入 n 个元素的副本, 物理页落在该线程的内存策略所指定的节点上
+        template <typename T>
+        static T *CopyToLocalStorage(const T *src, size_t n)
+        {
+            T *dst = (T *)AllocAlignedStorage(n * sizeof(T), HUGE_PAGE_TRANSPARENT);
+            if (dst == nullptr)
+            {
+                std::cerr << "Memory allocation failed for numa placement" << std::endl;
+                exit(-1);
+            }
+            memcpy(dst, src, n * sizeof(T));
+            return dst;
+        }
+
+        // replicate 模式下某个 NUMA 节点上的搜索数据副本, 存储用 AllocAlignedStorage 分配
+        struct NumaReplica
+        {
+            int node = 0;
+            float *emb = nullptr;
+            uint16_t *emb_half = nullptr;
+            float *loc = nullptr;
+            DEGSearchGraph graph;
+        };
+
+        NumaMode numa_mode_ = NUMA_OFF;
+        std::vector<int> numa_nodes_;           // 参与放置的 NUMA 节点
+        std::vector<NumaReplica> numa_replicas_; // replicate 模式下每个节点一份, 否则为空
+
+        std::vector<SearchContext *> search_context_pool_;
+        std::mutex search_context_lock_;
+        bool frozen_ = false;
 
         float alpha_;
         float max_emb_dist_, max_spatial_dist_;
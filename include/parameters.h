@@ -26,6 +26,15 @@ namespace stkq {
             }
         }
 
+        template<typename T>
+        inline T get(const std::string &name, const T &default_val) const {
+            auto item = params.find(name);
+            if (item == params.end()) {
+                return default_val;
+            }
+            return ConvertStrToValue<T>(item->second);
+        }
+
         inline std::string toString() const {
             std::string res;
             for (auto &param : params) {
@@ -0,0 +1,59 @@
+#ifndef STKQ_PQ_H
+#define STKQ_PQ_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace stkq
+{
+    // Product Quantization: embedding 切成 M 段, 每段用 k-means 训练 256 个中心, 编码为 M 字节.
+    // 查询时先算出 query 每段到 256 个中心的平方距离表 (ADC), 之后到任意编码的距离只需 M 次查表相加
+    class PQCodec
+    {
+    public:
+        static constexpr unsigned KSUB = 256; // 每段的中心数, 编码为 uint8
+
+        // 从 data 中随机抽取 sample 个向量, 每段做 iters 轮 k-means; dim 必须能被 M 整除
+        void Train(const float *data, size_t n, unsigned dim, unsigned M, size_t sample, unsigned iters);
+
+        // data 中 n 个向量编码到 codes, codes 需有 n * M 字节
+        void Encode(const float *data, size_t n, uint8_t *codes) const;
+
+        // query 到各段中心的平方距离表, table 需有 M * KSUB 个 float
+        void ComputeTable(const float *query, float *table) const;
+
+        // ADC 近似平方距离
+        inline float SqrDistance(const float *table, const uint8_t *code) const
+        {
+            float d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+            unsigned m = 0;
+            for (; m + 4 <= M_; m += 4, table += 4 * KSUB)
+            {
+                d0 += table[code[m]];
+                d1 += table[KSUB + code[m + 1]];
+                d2 += table[2 * KSUB + code[m + 2]];
+                d3 += table[3 * KSUB + code[m + 3]];
+            }
+            for (; m < M_; m++, table += KSUB)
+                d0 += table[code[m]];
+            return (d0 + d1) + (d2 + d3);
+        }
+
+        // 序列化格式: dim, M, 中心 (M * KSUB * dsub 个 float)
+        void Save(std::ostream &out) const;
+        bool Load(std::istream &in);
+
+        bool trained() const { return M_ != 0; }
+        unsigned dim() const { return dim_; }
+        unsigned M() const { return M_; }
+
+    private:
+        unsigned dim_ = 0;
+        unsigned M_ = 0;
+        unsigned dsub_ = 0;
+        std::vector<float> centroids_; // 第 m 段第 k 个中心位于 (m * KSUB + k) * dsub_
+    };
+}
+
+#endif
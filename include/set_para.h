@@ -1,6 +1,7 @@
 #include "parameters.h"
 #include <string.h>
 #include <iostream>
+#include <map>
 
 void HNSW_PARA(std::string dataset, stkq::Parameters &parameters)
 {
@@ -250,4 +251,52 @@ void set_para(std::string alg, std::string dataset, stkq::Parameters &parameters
         std::cout << "algorithm input error!\n";
         exit(-1);
     }
-}
\ No newline at end of file
+}
+
+// 命令行末尾可选的 key=value 参数及其说明, 在 set_para 之后写入 Parameters, 未设置时使用 builder 中的默认值
+const std::map<std::string, std::string> &search_options()
+{
+    static const std::map<std::string, std::string> options = {
+        {"compressed_graph", "1: 另外生成 StreamVByte 压缩邻接表, 增加解码遍历的搜索模式 (DEG)"},
+        {"disk_search", "1: SSD 模式, embedding 与邻接表按节点块从磁盘索引读取, 需要同时设置 sq8 或 pq_m (DEG)"},
+        {"disk_beam_width", "SSD 模式每轮批量读取的块数, [1, 64] (默认 4)"},
+        {"disk_file", "SSD 模式的磁盘索引文件 (默认 <graph_file>.disk), 不存在或与图不一致时重新写出"},
+        {"disk_direct", "1: 用 O_DIRECT 读取磁盘索引, 绕过页缓存 (默认 1)"},
+        {"disk_io_threads", "SSD 模式并行 pread 的 io 线程数 (默认 4)"},
+        {"graph_load", "SaveDEGIndex 格式的 DEG 索引的加载方式: mmap 直接在映射上搜索, copy 复制到内存 (默认 mmap)"},
+        {"huge_pages", "base embedding 与坐标的大页策略 off / thp / explicit (默认 thp)"},
+        {"mmap_populate", "1: 原生格式文件在加载时一次读入所有页, 0: 首次访问时才读入 (默认 1)"},
+        {"native_data", "存在 <file>.stkq 原生格式文件时的加载方式 mmap / copy / off (默认 mmap)"},
+        {"n_threads", "构建与搜索的线程数 (默认 8), 测单查询延迟时设为 1"},
+        {"numa", "只读搜索数据的 NUMA 放置策略 off / interleave / replicate, 启用时搜索线程轮流绑定到各节点 (默认 off)"},
+        {"pq_m", "PQ 每个 embedding 的编码字节数, 非 0 时增加 PQ 遍历 + 浮点重排的搜索模式 (DEG, 默认 0)"},
+        {"pq_file", "PQ 码本与编码的文件 (默认 <graph_file>.pq), 存在且一致时直接加载"},
+        {"pq_sample", "训练 PQ 码本的采样点数 (默认 20000)"},
+        {"pq_iters", "训练 PQ 码本的 k-means 迭代次数 (默认 10)"},
+        {"prefetch_distance", "路由时提前预取向量的后续邻居个数, 0 表示不预取 (DEG / HNSW, 默认 0)"},
+        {"search_budget", "每个查询的距离计算次数上限, 达到后停止扩展并返回当前结果, 0 表示不限制 (默认 0)"},
+        {"sign_filter", "1: 加载时生成符号码, 增加用 hamming 距离预筛候选的搜索模式 (DEG)"},
+        {"sign_quantile", "校准符号码距离估计的分位数, 越小预筛越保守 (默认 0.01)"},
+        {"sign_sample", "校准符号码距离估计的采样点数 (默认 200)"},
+        {"sq8", "1: 增加 SQ8 编码遍历 + 浮点重排的搜索模式, 与浮点模式逐 L 对比 (DEG)"},
+    };
+    return options;
+}
+
+void print_options()
+{
+    for (const auto &option : search_options())
+        std::cout << "  " << option.first << "=...  " << option.second << std::endl;
+}
+
+void set_option(const std::string &option, stkq::Parameters &parameters)
+{
+    const size_t eq = option.find('=');
+    if (eq == std::string::npos || search_options().count(option.substr(0, eq)) == 0)
+    {
+        std::cout << "unknown option: " << option << ", available options:" << std::endl;
+        print_options();
+        exit(-1);
+    }
+    parameters.set<std::string>(option.substr(0, eq), option.substr(eq + 1));
+}
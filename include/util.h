@@ -3,6 +3,9 @@
 
 #include <random>
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/mman.h>
 
 namespace stkq {
 
@@ -31,5 +34,86 @@ namespace stkq {
         // 最后，函数计算一个 [0, N) 范围内的随机偏移量 off，并将这个偏移量应用到数组中的每个元素上 
         // 这是通过取 (addr[i] + off) % N 实现的，确保结果仍然在 [0, N) 范围内
     }
+
+    // base 数据的大页策略: OFF 使用普通 4KB 页, TRANSPARENT 对映射调用 madvise(MADV_HUGEPAGE),
+    // EXPLICIT 先尝试 MAP_HUGETLB (需要预留 /proc/sys/vm/nr_hugepages), 失败时退回 TRANSPARENT
+    enum HugePageMode
+    {
+        HUGE_PAGE_OFF = 0,
+        HUGE_PAGE_TRANSPARENT,
+        HUGE_PAGE_EXPLICIT
+    };
+
+    static const size_t kStorageAlign = 64;      // 一条 cache line, 也是 AVX-512 寄存器宽度
+    static const size_t kHugePageSize = 2 << 20; // x86-64 的 2MB 大页
+
+    // 存放在 AllocAlignedStorage 返回地址之前的 64 字节中
+    struct AlignedStorageHeader
+    {
+        void *base;    // 映射或 aligned_alloc 的起点
+        size_t length; // 映射长度, 0 表示由 aligned_alloc 分配
+    };
+
+    // 分配起点 64 字节对齐的存储, 不小于 2MB 时用匿名 mmap 并按 2MB 对齐以便整段由大页覆盖;
+    // 只对齐起点, 不对行做填充: 调用方以 dim 为行距, 行长是 64 字节的倍数时每一行才按 cache line 对齐
+    // 返回地址之前的 64 字节记录映射的起点与长度, 必须用 FreeAlignedStorage 释放; used 返回实际生效的策略
+    inline void *AllocAlignedStorage(size_t bytes, HugePageMode mode, HugePageMode *used = nullptr)
+    {
+        if (mode == HUGE_PAGE_OFF || bytes < kHugePageSize)
+        {
+            char *base = (char *)aligned_alloc(kStorageAlign, kStorageAlign + (bytes + kStorageAlign - 1) / kStorageAlign * kStorageAlign);
+            if (base == nullptr)
+                return nullptr;
+            *(AlignedStorageHeader *)base = {base, 0};
+            if (used)
+                *used = HUGE_PAGE_OFF;
+            return base + kStorageAlign;
+        }
+        const size_t rounded = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+        if (mode == HUGE_PAGE_EXPLICIT)
+        {
+            // hugetlb 映射本身按大页对齐, 头部占用第一个大页的前 64 字节
+            const size_t length = rounded + kHugePageSize;
+            void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                *(AlignedStorageHeader *)p = {p, length};
+                if (used)
+                    *used = HUGE_PAGE_EXPLICIT;
+                return (char *)p + kStorageAlign;
+            }
+        }
+        // 多映射两个大页, 把数据起点对齐到 2MB 边界, 头部放在起点之前; 未触及的页不占物理内存
+        const size_t length = rounded + 2 * kHugePageSize;
+        void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+        char *data = (char *)(((uintptr_t)p + kStorageAlign + kHugePageSize - 1) / kHugePageSize * kHugePageSize);
+        *(AlignedStorageHeader *)(data - kStorageAlign) = {p, length};
+        madvise(data, rounded, MADV_HUGEPAGE);
+        if (used)
+            *used = HUGE_PAGE_TRANSPARENT;
+        return data;
+    }
+
+    inline void FreeAlignedStorage(void *data)
+    {
+        if (data == nullptr)
+            return;
+        const AlignedStorageHeader header = *(const AlignedStorageHeader *)((char *)data - kStorageAlign);
+        if (header.length == 0)
+            free(header.base);
+        else
+            munmap(header.base, header.length);
+    }
+
+    // 对已有的大块内存 (如 std::vector 的存储) 中完整覆盖的 2MB 区间建议使用透明大页
+    inline void AdviseHugePages(const void *data, size_t bytes)
+    {
+        const uintptr_t begin = ((uintptr_t)data + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+        const uintptr_t end = ((uintptr_t)data + bytes) / kHugePageSize * kHugePageSize;
+        if (end > begin)
+            madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+    }
 }
 #endif
\ No newline at end of file
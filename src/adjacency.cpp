@@ -0,0 +1,201 @@
+#include "adjacency.h"
+#include "distance.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cstring>
+
+namespace stkq
+{
+    // StreamVByte 查找表: 控制字节 c 描述 4 个值的字节数, shuffle[c] 把它们展开为 4 个 uint32, length[c] 为总字节数
+    struct StreamVByteTables
+    {
+        uint8_t shuffle[256][16];
+        uint8_t length[256];
+
+        StreamVByteTables()
+        {
+            for (unsigned c = 0; c < 256; c++)
+            {
+                unsigned pos = 0;
+                for (unsigned i = 0; i < 4; i++)
+                {
+                    const unsigned len = ((c >> (2 * i)) & 3) + 1;
+                    for (unsigned b = 0; b < 4; b++)
+                        shuffle[c][4 * i + b] = b < len ? pos + b : 0x80;
+                    pos += len;
+                }
+                length[c] = pos;
+            }
+        }
+    };
+
+    static const StreamVByteTables kStreamVByteTables;
+
+    static inline unsigned ValueBytes(uint32_t v)
+    {
+        return v < (1u << 8) ? 1 : v < (1u << 16) ? 2 : v < (1u << 24) ? 3 : 4;
+    }
+
+    // 从第 i 个值开始逐个解码, prev 为第 i - 1 个 id
+    static inline const uint8_t *ScalarDecodeFrom(const uint8_t *control, const uint8_t *data, unsigned i, unsigned n,
+                                                  uint32_t prev, unsigned *out)
+    {
+        for (; i < n; i++)
+        {
+            const unsigned len = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+            uint32_t delta = 0;
+            memcpy(&delta, data, len);
+            data += len;
+            prev += delta;
+            out[i] = prev;
+        }
+        return data;
+    }
+
+    static const uint8_t *ScalarDecode(const uint8_t *control, const uint8_t *data, unsigned n, unsigned *out)
+    {
+        return ScalarDecodeFrom(control, data, 0, n, 0, out);
+    }
+
+    // 每次用 pshufb 展开 4 个差分, 再做 4 路前缀和
+    __attribute__((target("ssse3"))) static const uint8_t *SSSE3Decode(const uint8_t *control, const uint8_t *data,
+                                                                        unsigned n, unsigned *out)
+    {
+        __m128i prev = _mm_setzero_si128();
+        unsigned i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const uint8_t c = control[i / 4];
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data),
+                                         _mm_loadu_si128((const __m128i *)kStreamVByteTables.shuffle[c]));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, prev);
+            _mm_storeu_si128((__m128i *)(out + i), v);
+            prev = _mm_shuffle_epi32(v, 0xFF);
+            data += kStreamVByteTables.length[c];
+        }
+        return ScalarDecodeFrom(control, data, i, n, i == 0 ? 0 : out[i - 1], out);
+    }
+
+    static const AdjacencyDecoder kScalarDecoder = {"scalar", ScalarDecode};
+    static const AdjacencyDecoder kSSSE3Decoder = {"ssse3", SSSE3Decode};
+
+    std::vector<const AdjacencyDecoder *> GetSupportedAdjacencyDecoders()
+    {
+        std::vector<const AdjacencyDecoder *> decoders;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+            decoders.push_back(&kSSSE3Decoder);
+        decoders.push_back(&kScalarDecoder);
+        return decoders;
+    }
+
+    const AdjacencyDecoder &GetAdjacencyDecoder()
+    {
+        static const AdjacencyDecoder *decoder = std::strcmp(GetDistanceKernels().name, "scalar") == 0
+                                                     ? &kScalarDecoder
+                                                     : GetSupportedAdjacencyDecoders()[0];
+        return *decoder;
+    }
+
+    void CompressedAdjacency::EncodeRecord(size_t begin, size_t end, const unsigned *ids, const unsigned *range_offsets,
+                                           const std::pair<int8_t, int8_t> *ranges, std::vector<uint8_t> &out)
+    {
+        const unsigned n = (unsigned)(end - begin);
+        std::vector<size_t> order(n);
+        for (unsigned j = 0; j < n; j++)
+            order[j] = begin + j;
+        std::stable_sort(order.begin(), order.end(), [ids](size_t a, size_t b)
+                         { return ids[a] < ids[b]; });
+
+        if (n < 255)
+            out.push_back(n);
+        else
+        {
+            out.push_back(255);
+            out.insert(out.end(), (const uint8_t *)&n, (const uint8_t *)&n + 4);
+        }
+        const size_t control = out.size();
+        out.resize(out.size() + (n + 3) / 4, 0);
+        uint32_t prev = 0;
+        for (unsigned j = 0; j < n; j++)
+        {
+            const uint32_t delta = ids[order[j]] - prev;
+            const unsigned len = ValueBytes(delta);
+            out[control + j / 4] |= (len - 1) << (2 * (j % 4));
+            out.insert(out.end(), (const uint8_t *)&delta, (const uint8_t *)&delta + len);
+            prev = ids[order[j]];
+        }
+
+        // 区间截断到 [0, 100] 后对 [0, 100] 内的 alpha 判断结果不变, 完全落在外面的区间丢弃;
+        // 没有剩余区间的边写一个不可能命中的 [101, 0]
+        for (unsigned j = 0; j < n; j++)
+        {
+            const size_t e = order[j];
+            const size_t first = out.size();
+            for (unsigned r = range_offsets[e]; r < range_offsets[e + 1]; r++)
+            {
+                const int lo = std::max<int>(ranges[r].first, 0), hi = std::min<int>(ranges[r].second, 100);
+                if (lo > hi)
+                    continue;
+                if (out.size() > first)
+                    out[out.size() - 2] |= 0x80;
+                out.push_back(lo);
+                out.push_back(hi);
+            }
+            if (out.size() == first)
+            {
+                out.push_back(101);
+                out.push_back(0);
+            }
+        }
+    }
+
+    unsigned CompressedAdjacency::DecodeRecord(const uint8_t *record, float alpha100, unsigned *out,
+                                               const AdjacencyDecoder &decoder)
+    {
+        const uint8_t *p = record;
+        unsigned n = *p++;
+        if (n == 255)
+        {
+            memcpy(&n, p, 4);
+            p += 4;
+        }
+        const uint8_t *range = decoder.decode(p, p + (n + 3) / 4, n, out);
+        if (!(alpha100 >= 0 && alpha100 <= 100))
+            return 0;
+        unsigned kept = 0;
+        for (unsigned j = 0; j < n; j++)
+        {
+            bool active = false;
+            uint8_t lo;
+            do
+            {
+                lo = range[0];
+                active |= alpha100 >= (lo & 0x7F) && alpha100 <= range[1];
+                range += 2;
+            } while (lo & 0x80);
+            out[kept] = out[j];
+            kept += active;
+        }
+        return kept;
+    }
+
+    void CompressedAdjacency::Build(size_t node_num, const size_t *offsets, const unsigned *ids,
+                                    const unsigned *range_offsets, const std::pair<int8_t, int8_t> *ranges)
+    {
+        std::vector<uint64_t>(node_num + 1, 0).swap(offsets_);
+        std::vector<uint8_t>().swap(bytes_);
+        max_degree_ = 0;
+        decoder_ = &GetAdjacencyDecoder();
+        for (size_t u = 0; u < node_num; u++)
+        {
+            max_degree_ = std::max(max_degree_, (unsigned)(offsets[u + 1] - offsets[u]));
+            EncodeRecord(offsets[u], offsets[u + 1], ids, range_offsets, ranges, bytes_);
+            offsets_[u + 1] = bytes_.size();
+        }
+        bytes_.resize(bytes_.size() + 16, 0);
+        bytes_.shrink_to_fit();
+    }
+}
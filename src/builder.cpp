@@ -67,6 +67,12 @@ namespace stkq
         s = std::chrono::high_resolution_clock::now();
         ComponentInit *a = nullptr;
 
+        if (final_index_->getEmbPrecision() != EMB_FLOAT32)
+        {
+            std::cerr << "index construction requires float embeddings, load with emb_precision = float" << std::endl;
+            exit(-1);
+        }
+
         if (type == INIT_HNSW)
         {
             std::cout << "__INIT : HNSW__" << std::endl;
@@ -154,6 +160,33 @@ namespace stkq
             return this;
         }
 
+        if (type == INDEX_DEG)
+        {
+            // 刚构建的索引先由 friends 生成只读搜索图 (同时使内存中的索引可以直接搜索);
+            // 从文件加载 (或经过 reorder) 的索引只有只读搜索图, 直接写出
+            const bool built = !final_index_->DEG_nodes_.empty();
+            if (built)
+                final_index_->BuildDEGSearchGraph(final_index_->getBaseLocData(), final_index_->getBaseLocDim());
+            final_index_->SaveDEGIndex(graph_file);
+
+            // 重排后的内部 id 到原始 id 的映射, load_graph 时用于重排原始顺序的 base 数据;
+            // 新建的图按原始 id 保存, 之前 reorder 留下的映射已失效
+            std::string perm_file = std::string(graph_file) + ".perm";
+            if (final_index_->hasPermutation())
+            {
+                std::ofstream perm_out(perm_file, std::ios::binary);
+                unsigned perm_size = final_index_->getPermutation().size();
+                perm_out.write((char *)&perm_size, sizeof(unsigned));
+                perm_out.write((char *)final_index_->getPermutation().data(), perm_size * sizeof(unsigned));
+            }
+            else
+                std::remove(perm_file.c_str());
+            // 图文件旁的 PQ 编码按旧的 id 顺序保存, 下次搜索时重新训练
+            if (!built)
+                std::remove((std::string(graph_file) + ".pq").c_str());
+            return this;
+        }
+
         std::fstream out(graph_file, std::ios::binary | std::ios::out);
         if (type == INDEX_HNSW)
         {
@@ -182,54 +215,6 @@ namespace stkq
             out.close();
             return this;
         }
-        else if (type == INDEX_DEG)
-        {
-            int average_neighbor_size = 0;
-            unsigned enterpoint_set_size = final_index_->DEG_enterpoints.size();
-            out.write((char *)&enterpoint_set_size, sizeof(unsigned));
-            for (unsigned i = 0; i < enterpoint_set_size; i++)
-            {
-                unsigned node_id = final_index_->DEG_enterpoints[i]->GetId();
-                out.write((char *)&node_id, sizeof(unsigned));
-            }
-
-            for (unsigned i = 0; i < final_index_->getBaseLen(); i++)
-            {
-                unsigned node_id = final_index_->DEG_nodes_[i]->GetId();
-                out.write((char *)&node_id, sizeof(unsigned));
-                unsigned neighbor_size = final_index_->DEG_nodes_[i]->GetFriends().size();
-                out.write((char *)&neighbor_size, sizeof(unsigned));
-                average_neighbor_size = average_neighbor_size + neighbor_size;
-
-                for (unsigned k = 0; k < neighbor_size; k++)
-                {
-                    Index::DEGNeighbor &neighbor = final_index_->DEG_nodes_[i]->GetFriends()[k];
-                    unsigned neighbor_id = neighbor.id_;
-                    out.write((char *)&neighbor_id, sizeof(unsigned));
-
-                    std::vector<std::pair<float, float>> use_range = neighbor.available_range;
-                    // unsigned range_size = use_range.size();
-                    // out.write((char *)&range_size, sizeof(unsigned));
-                    // for (unsigned t = 0; t < range_size; t++)
-                    // {
-                    //     out.write((char *)&use_range[t].first, sizeof(float));
-                    //     out.write((char *)&use_range[t].second, sizeof(float));
-                    // }
-
-                    unsigned range_size = use_range.size();
-                    out.write((char *)&range_size, sizeof(unsigned));
-                    for (unsigned t = 0; t < range_size; t++)
-                    {
-                        int8_t x = static_cast<int8_t>(use_range[t].first * 100);
-                        int8_t y = static_cast<int8_t>(use_range[t].second * 100);
-                        out.write((char *)&x, sizeof(int8_t));
-                        out.write((char *)&y, sizeof(int8_t));
-                    }
-                }
-            }
-            out.close();
-            return this;
-        }
         else if (type == INDEX_RTREE)
         {
             out.close();
@@ -262,6 +247,35 @@ namespace stkq
         return this;
     }
 
+    IndexBuilder *IndexBuilder::reorder(TYPE type, const std::string &method)
+    {
+        if (type != INDEX_DEG)
+        {
+            std::cerr << "reorder is only supported for the DEG index" << std::endl;
+            exit(-1);
+        }
+        // 平均每条边两端 id 之差, 越小说明邻居在 base 数组中越集中
+        auto edge_gap = [this]()
+        {
+            const Index::DEGSearchGraph &search_graph = final_index_->DEG_search_graph_;
+            double gap = 0;
+            for (unsigned i = 0; i < final_index_->getBaseLen(); i++)
+            {
+                for (size_t e = search_graph.EdgeBegin(i); e < search_graph.EdgeEnd(i); e++)
+                    gap += std::abs((double)search_graph.ids[e] - i);
+            }
+            return gap / std::max<size_t>(search_graph.ids.size(), 1);
+        };
+        const double gap_before = edge_gap();
+        auto reorder_s = std::chrono::high_resolution_clock::now();
+        const std::vector<unsigned> perm = final_index_->ComputeDEGOrder(method);
+        final_index_->ApplyDEGPermutation(perm);
+        std::chrono::duration<double> reorder_diff = std::chrono::high_resolution_clock::now() - reorder_s;
+        std::cout << "reorder (" << method << ") time: " << reorder_diff.count()
+                  << "s, average edge id gap: " << gap_before << " -> " << edge_gap() << std::endl;
+        return this;
+    }
+
     IndexBuilder *IndexBuilder::load_graph(TYPE type, char *graph_file)
     {
         int average_neighbor_size = 0;
@@ -332,7 +346,7 @@ namespace stkq
                 in.close(); // Close the file after reading
             }
             std::cout << "average_neighbor_size: " << average_neighbor_size / final_index_->getBaseLen() << std::endl;
-
+            final_index_->setFrozen(true);
             return this;
         }
 
@@ -382,56 +396,85 @@ namespace stkq
             }
             std::cout << "average_neighbor_size: " << average_neighbor_size / final_index_->getBaseLen() << std::endl;
             final_index_->enterpoint_ = final_index_->nodes_[enterpoint_id];
+            final_index_->setFrozen(true);
             return this;
         }
         else if (type == INDEX_DEG)
         {
-            int average_neighbor_size = 0;
-            final_index_->DEG_nodes_.resize(final_index_->getBaseLen());
-            for (unsigned i = 0; i < final_index_->getBaseLen(); i++)
+            // 加载后只用于搜索, 不再为每个点分配 DEGNode (及其 mutex)
+            // graph_load = mmap (默认) / copy: SaveDEGIndex 格式的索引直接在映射上搜索, 或复制到内存;
+            // mmap_populate = 1 (默认) 时加载阶段一次性读入所有页. 旧格式的索引逐条解析
+            const Parameters &param = final_index_->getParam();
+            const std::string graph_load = param.get<std::string>("graph_load", "mmap");
+            if (graph_load != "mmap" && graph_load != "copy")
             {
-                final_index_->DEG_nodes_[i] = new stkq::DEG::DEGNode(0, 0);
+                std::cerr << "graph_load must be mmap or copy" << std::endl;
+                exit(-1);
             }
-            unsigned enterpoint_id, enterpoint_size;
-            final_index_->enterpoint_set.clear();
-            in.read((char *)&enterpoint_size, sizeof(unsigned));
-            for (unsigned i = 0; i < enterpoint_size; i++)
+            Index::DEGSearchGraph &search_graph = final_index_->DEG_search_graph_;
+            auto load_s = std::chrono::high_resolution_clock::now();
+            if (final_index_->LoadDEGIndex(graph_file, final_index_->getBaseLen(), graph_load == "copy",
+                                           param.get<unsigned>("mmap_populate", 1) != 0))
+                std::cout << (graph_load == "copy" ? "loaded " : "mapped ") << graph_file << std::endl;
+            else
             {
-                in.read((char *)&enterpoint_id, sizeof(unsigned));
-                final_index_->enterpoint_set.push_back(enterpoint_id);
-            }
+                unsigned enterpoint_id, enterpoint_size;
+                final_index_->enterpoint_set.clear();
+                in.read((char *)&enterpoint_size, sizeof(unsigned));
+                for (unsigned i = 0; i < enterpoint_size; i++)
+                {
+                    in.read((char *)&enterpoint_id, sizeof(unsigned));
+                    final_index_->enterpoint_set.push_back(enterpoint_id);
+                }
 
-            for (unsigned i = 0; i < final_index_->getBaseLen(); i++)
-            {
-                unsigned node_id, neighbor_size;
-                in.read((char *)&node_id, sizeof(unsigned));
-                final_index_->DEG_nodes_[i]->SetId(node_id);
-                in.read((char *)&neighbor_size, sizeof(unsigned));
-                average_neighbor_size = average_neighbor_size + neighbor_size;
-                final_index_->DEG_nodes_[i]->SetMaxM(neighbor_size);
-                std::vector<Index::DEGSimpleNeighbor> neighbors;
-                neighbors.reserve(neighbor_size);
-                int max_layer = 0;
-                for (unsigned k = 0; k < neighbor_size; k++)
+                // 邻居及其 alpha 区间直接写入 CSR 搜索图
+                search_graph.clear();
+                search_graph.reserve(final_index_->getBaseLen(), 0);
+                std::vector<std::pair<int8_t, int8_t>> use_range;
+
+                for (unsigned i = 0; i < final_index_->getBaseLen(); i++)
                 {
-                    unsigned neighbor_id;
-                    in.read((char *)&neighbor_id, sizeof(unsigned));
-                    unsigned range_size;
-                    in.read((char *)&range_size, sizeof(unsigned));
-                    std::vector<std::pair<int8_t, int8_t>> use_range;
-                    use_range.reserve(range_size + 1);
-                    for (unsigned t = 0; t < range_size; t++)
+                    unsigned node_id, neighbor_size;
+                    in.read((char *)&node_id, sizeof(unsigned));
+                    in.read((char *)&neighbor_size, sizeof(unsigned));
+                    for (unsigned k = 0; k < neighbor_size; k++)
                     {
-                        int8_t range_start, range_end;
-                        in.read((char *)&range_start, sizeof(int8_t));
-                        in.read((char *)&range_end, sizeof(int8_t));
-                        use_range.push_back(std::make_pair(range_start, range_end));
+                        unsigned neighbor_id;
+                        in.read((char *)&neighbor_id, sizeof(unsigned));
+                        unsigned range_size;
+                        in.read((char *)&range_size, sizeof(unsigned));
+                        use_range.resize(range_size);
+                        in.read((char *)use_range.data(), range_size * sizeof(std::pair<int8_t, int8_t>));
+                        search_graph.AddEdge(neighbor_id, use_range.data(), range_size);
                     }
-                    neighbors.push_back(Index::DEGSimpleNeighbor(neighbor_id, use_range));
+                    search_graph.FinishNode();
                 }
-                final_index_->DEG_nodes_[i]->SetSearchFriends(neighbors);
+                search_graph.BuildActiveMasks();
             }
-            std::cout << "average_neighbor_size: " << average_neighbor_size / final_index_->getBaseLen() << std::endl;
+
+            // 经过 reorder 的索引旁有 <graph_file>.perm (新 id -> 原始 id), 原始顺序的 base 数据据此重排
+            std::ifstream perm_in(std::string(graph_file) + ".perm", std::ios::binary);
+            if (perm_in.is_open())
+            {
+                unsigned perm_size = 0;
+                perm_in.read((char *)&perm_size, sizeof(unsigned));
+                std::vector<unsigned> new_to_old(perm_size);
+                perm_in.read((char *)new_to_old.data(), perm_size * sizeof(unsigned));
+                if (!perm_in || perm_size != final_index_->getBaseLen())
+                {
+                    std::cerr << "load permutation error: " << graph_file << ".perm" << std::endl;
+                    exit(-1);
+                }
+                final_index_->SetDEGPermutation(new_to_old);
+                std::cout << "base data reordered by " << graph_file << ".perm" << std::endl;
+            }
+            // 索引文件中的内联坐标与 (重排后的) base 坐标不一致时重新生成
+            if (!search_graph.InlineLocsMatch(final_index_->getBaseLocData(), final_index_->getBaseLocDim()))
+                search_graph.BuildInlineLocs(final_index_->getBaseLocData(), final_index_->getBaseLocDim());
+            std::chrono::duration<double> load_diff = std::chrono::high_resolution_clock::now() - load_s;
+            std::cout << "graph load time: " << load_diff.count() << "s" << std::endl;
+            std::cout << "average_neighbor_size: " << search_graph.ids.size() / final_index_->getBaseLen() << std::endl;
+            final_index_->setFrozen(true);
             return this;
         }
 
@@ -445,6 +488,7 @@ namespace stkq
             in.read((char *)tmp.data(), GK * sizeof(unsigned));
             final_index_->getLoadGraph().push_back(tmp);
         }
+        final_index_->setFrozen(true);
         return this;
     }
 
@@ -590,7 +634,8 @@ namespace stkq
             std::cout << "error for index type" << std::endl;
             exit(1);
         }
-
+        final_index_1->setFrozen(true);
+        final_index_2->setFrozen(true);
         return this;
     }
     /**
@@ -605,10 +650,46 @@ namespace stkq
 
         unsigned K = 10; // 在近邻搜索中要找到的最近邻的数量
 
+        // 查询按线程划分, 各路由只读取不可变的索引状态, 查询的 alpha 作为参数传入, 不再逐查询写共享的 Index
+        const unsigned search_threads = param_.get<unsigned>("n_threads");
+        std::cout << "search threads: " << search_threads << std::endl;
+        // 每个查询的距离计算次数上限, 0 表示不限制
+        const unsigned search_budget = param_.get<unsigned>("search_budget", 0);
+        // 路由时提前预取向量的后续邻居个数, 0 表示不预取; 在 howto100m 上没有测到收益 (见 BENCHMARKS.md), 默认关闭
+        const unsigned prefetch_distance = param_.get<unsigned>("prefetch_distance", 0);
+        std::cout << "prefetch distance: " << prefetch_distance << std::endl;
+        std::cout << "distance kernels: " << GetDistanceKernels().name << std::endl;
+
+        // fp16 / bf16 存储的 base embedding 只有 DEG 路由支持
+        const bool dual = route_type == DUAL_ROUTER_HNSW || route_type == ROUTER_RTREE_HNSW;
+        if ((dual ? final_index_1 : final_index_)->getEmbPrecision() != EMB_FLOAT32 && route_type != ROUTER_DEG)
+        {
+            std::cerr << "fp16 / bf16 embeddings are only supported by the DEG router" << std::endl;
+            exit(-1);
+        }
+
+        // numa = off / interleave / replicate: 只读搜索数据的 NUMA 放置策略, 见 Index::PlaceSearchData;
+        // 启用时搜索线程按编号轮流绑定到各节点
+        const std::string numa = param_.get<std::string>("numa", "off");
+        if (numa != "off" && numa != "interleave" && numa != "replicate")
+        {
+            std::cerr << "unknown numa mode: " << numa << std::endl;
+            exit(-1);
+        }
+        if (numa != "off" && dual)
+        {
+            std::cerr << "numa placement is only supported by single-index routers" << std::endl;
+            exit(-1);
+        }
+        // 副本只在 DEG 路由中按线程选择, 其他路由直接读取 Index 自身的存储
+        if (numa == "replicate" && route_type != ROUTER_DEG)
+        {
+            std::cerr << "numa replicate is only supported by the DEG router" << std::endl;
+            exit(-1);
+        }
+
         if (route_type == DUAL_ROUTER_HNSW)
         {
-            final_index_1->getParam().set<unsigned>("K_search", K);
-            final_index_2->getParam().set<unsigned>("K_search", K);
             std::vector<std::vector<unsigned>> res_1;
             std::vector<std::vector<unsigned>> res_2;
             std::cout << "__ROUTER : DUAL_HNSW__" << std::endl;
@@ -631,8 +712,6 @@ namespace stkq
                 for (unsigned t = 0; t < 20; t++)
                 {
                     L = L + K;
-                    final_index_1->getParam().set<unsigned>("K_search", L);
-                    final_index_2->getParam().set<unsigned>("K_search", L);
                     std::cout << "SEARCH_L : " << L << std::endl;
                     if (L < K)
                     {
@@ -640,34 +719,56 @@ namespace stkq
                         exit(-1);
                     }
 
-                    final_index_1->getParam().set<unsigned>("L_search", L);
-                    final_index_2->getParam().set<unsigned>("L_search", L);
-
                     auto s1 = std::chrono::high_resolution_clock::now();
 
                     res_1.clear();
                     res_1.resize(final_index_1->getQueryLen());
-                    for (unsigned i = 0; i < final_index_1->getQueryLen(); i++)
+                    const float alpha_1 = final_index_1->get_alpha();
+#pragma omp parallel num_threads(search_threads)
                     {
-                        std::vector<Index::Neighbor> pool;
-                        a1->SearchEntryInner(i, pool);
-                        b1->RouteInner(i, pool, res_1[i]);
+                        Index::SearchContext *ctx = final_index_1->AcquireSearchContext();
+                        Index::SearchResult result;
+#pragma omp for schedule(dynamic, 16)
+                        for (unsigned i = 0; i < final_index_1->getQueryLen(); i++)
+                        {
+                            Index::SearchRequest req = final_index_1->MakeSearchRequest(i, alpha_1, L, L);
+                            req.budget = search_budget;
+                            req.prefetch_distance = prefetch_distance;
+                            ctx->pool.clear();
+                            a1->SearchEntryInner(req, ctx->pool);
+                            b1->RouteInner(req, ctx, result);
+                            res_1[i].swap(result.ids);
+                        }
+                        final_index_1->ReleaseSearchContext(ctx);
                     }
 
                     res_2.clear();
                     res_2.resize(final_index_2->getQueryLen());
-                    for (unsigned i = 0; i < final_index_2->getQueryLen(); i++)
+                    const float alpha_2 = final_index_2->get_alpha();
+#pragma omp parallel num_threads(search_threads)
                     {
-                        std::vector<Index::Neighbor> pool;
-                        a2->SearchEntryInner(i, pool);
-                        b2->RouteInner(i, pool, res_2[i]);
+                        Index::SearchContext *ctx = final_index_2->AcquireSearchContext();
+                        Index::SearchResult result;
+#pragma omp for schedule(dynamic, 16)
+                        for (unsigned i = 0; i < final_index_2->getQueryLen(); i++)
+                        {
+                            Index::SearchRequest req = final_index_2->MakeSearchRequest(i, alpha_2, L, L);
+                            req.budget = search_budget;
+                            req.prefetch_distance = prefetch_distance;
+                            ctx->pool.clear();
+                            a2->SearchEntryInner(req, ctx->pool);
+                            b2->RouteInner(req, ctx, result);
+                            res_2[i].swap(result.ids);
+                        }
+                        final_index_2->ReleaseSearchContext(ctx);
                     }
 
-                    std::priority_queue<Index::CloserFirst> result_queue;
-                    std::vector<std::vector<unsigned>> res;
+                    std::vector<std::vector<unsigned>> res(res_1.size());
 
+#pragma omp parallel for schedule(dynamic, 16) num_threads(search_threads)
                     for (int i = 0; i < res_1.size(); i++)
                     {
+                        std::priority_queue<Index::CloserFirst> result_queue;
                         for (int j = 0; j < res_1[i].size(); j++)
                         {
                             float e_d = final_index_1->get_E_Dist()->compare(final_index_1->getQueryEmbData() + i * final_index_1->getBaseEmbDim(),
@@ -710,13 +811,14 @@ namespace stkq
                             }
                             result_queue.pop();
                         }
-                        res.push_back(tmp_res);
+                        res[i].swap(tmp_res);
                     }
 
                     auto e1 = std::chrono::high_resolution_clock::now();
                     // auto e2 = std::chrono::high_resolution_clock::now();
                     std::chrono::duration<double> diff = e1 - s1;
                     std::cout << "search time: " << diff.count() / final_index_1->getQueryLen() << "\n";
+                    std::cout << "QPS: " << final_index_1->getQueryLen() / diff.count() << "\n";
 
                     float recall = 0;
 
@@ -755,7 +857,6 @@ namespace stkq
         else if (route_type == ROUTER_RTREE_HNSW)
         {
             // final_index_1->getParam().set<unsigned>("K_search", K);
-            final_index_2->getParam().set<unsigned>("K_search", K);
             std::vector<std::vector<unsigned>> res_1;
             std::vector<std::vector<unsigned>> res_2;
             std::cout << "__ROUTER : ROUTER_RTREE_HNSW__" << std::endl;
@@ -778,20 +879,19 @@ namespace stkq
                 for (unsigned t = 0; t < 30; t++)
                 {
                     L = L + K;
-                    final_index_2->getParam().set<unsigned>("K_search", L);
                     std::cout << "SEARCH_L : " << L << std::endl;
                     if (L < K)
                     {
                         std::cout << "search_L cannot be smaller than search_K! " << std::endl;
                         exit(-1);
                     }
-                    final_index_2->getParam().set<unsigned>("L_search", L);
 
                     auto s1 = std::chrono::high_resolution_clock::now();
 
                     res_1.clear();
                     res_1.resize(final_index_1->getQueryLen());
 
+#pragma omp parallel for schedule(dynamic, 16) num_threads(search_threads)
                     for (unsigned i = 0; i < final_index_1->getQueryLen(); i++)
                     {
                         std::vector<Index::Neighbor> pool;
@@ -811,11 +911,23 @@ namespace stkq
 
                     res_2.clear();
                     res_2.resize(final_index_2->getQueryLen());
-                    for (unsigned i = 0; i < final_index_2->getQueryLen(); i++)
+                    const float alpha_2 = final_index_2->get_alpha();
+#pragma omp parallel num_threads(search_threads)
                     {
-                        std::vector<Index::Neighbor> pool;
-                        a2->SearchEntryInner(i, pool);
-                        b2->RouteInner(i, pool, res_2[i]);
+                        Index::SearchContext *ctx = final_index_2->AcquireSearchContext();
+                        Index::SearchResult result;
+#pragma omp for schedule(dynamic, 16)
+                        for (unsigned i = 0; i < final_index_2->getQueryLen(); i++)
+                        {
+                            Index::SearchRequest req = final_index_2->MakeSearchRequest(i, alpha_2, L, L);
+                            req.budget = search_budget;
+                            req.prefetch_distance = prefetch_distance;
+                            ctx->pool.clear();
+                            a2->SearchEntryInner(req, ctx->pool);
+                            b2->RouteInner(req, ctx, result);
+                            res_2[i].swap(result.ids);
+                        }
+                        final_index_2->ReleaseSearchContext(ctx);
                     }
                     auto s3 = std::chrono::high_resolution_clock::now();
                     total_duration = s3 - s2;
@@ -829,11 +941,12 @@ namespace stkq
 
                     final_index_2->resetDistCount();
                     final_index_2->resetHopCount();
-                    std::priority_queue<Index::CloserFirst> result_queue;
-                    std::vector<std::vector<unsigned>> res;
+                    std::vector<std::vector<unsigned>> res(res_1.size());
 
+#pragma omp parallel for schedule(dynamic, 16) num_threads(search_threads)
                     for (int i = 0; i < res_1.size(); i++)
                     {
+                        std::priority_queue<Index::CloserFirst> result_queue;
                         for (int j = 0; j < res_1[i].size(); j++)
                         {
                             float e_d = final_index_1->get_E_Dist()->compare(final_index_1->getQueryEmbData() + i * final_index_1->getBaseEmbDim(),
@@ -873,13 +986,14 @@ namespace stkq
                             }
                             result_queue.pop();
                         }
-                        res.push_back(tmp_res);
+                        res[i].swap(tmp_res);
                     }
 
                     auto e1 = std::chrono::high_resolution_clock::now();
                     // auto e2 = std::chrono::high_resolution_clock::now();
                     std::chrono::duration<double> diff = e1 - s1;
                     std::cout << "search time: " << diff.count() / final_index_1->getQueryLen() << "\n";
+                    std::cout << "QPS: " << final_index_1->getQueryLen() / diff.count() << "\n";
 
                     float recall = 0;
 
@@ -919,8 +1033,6 @@ namespace stkq
             return this;
         }
 
-        final_index_->getParam().set<unsigned>("K_search", K); // 这行代码设置了索引的参数K_search为K的值. 这意味着在后续的搜索中, 将寻找每个查询点的10个最近邻
-
         std::vector<std::vector<unsigned>> res;
 
         // ENTRY
@@ -970,6 +1082,147 @@ namespace stkq
         }
         // std::cout << final_index_->alpha << std::endl;
 
+        // SQ8: DEG 路由用量化编码遍历, 最终候选集用浮点距离重排
+        const bool sq8 = param_.get<unsigned>("sq8", 0) != 0;
+        const unsigned pq_m = param_.get<unsigned>("pq_m", 0);
+        if (sq8 && route_type != ROUTER_DEG)
+        {
+            std::cerr << "sq8 is only supported by the DEG router" << std::endl;
+            exit(-1);
+        }
+        if ((sq8 || pq_m != 0) && final_index_->getEmbPrecision() != EMB_FLOAT32)
+        {
+            std::cerr << "sq8 / pq re-ranking requires float embeddings" << std::endl;
+            exit(-1);
+        }
+        if (sq8 && !final_index_->hasSQ8())
+        {
+            auto sq8_s = std::chrono::high_resolution_clock::now();
+            final_index_->BuildSQ8();
+            std::chrono::duration<double> sq8_diff = std::chrono::high_resolution_clock::now() - sq8_s;
+            std::cout << "sq8 encode time: " << sq8_diff.count() << "s, step: " << final_index_->getSQ8Step() << std::endl;
+        }
+
+        // PQ: pq_m 为每个 embedding 的编码字节数 (0 表示不启用), 同样只用于 DEG 路由的遍历, 最终用浮点距离重排;
+        // 码本与编码保存在图文件旁的 <graph_file>.pq, 存在且与当前数据一致时直接加载, 否则重新训练并写回
+        if (pq_m != 0 && route_type != ROUTER_DEG)
+        {
+            std::cerr << "pq is only supported by the DEG router" << std::endl;
+            exit(-1);
+        }
+        if (pq_m != 0 && !final_index_->hasPQ())
+        {
+            const std::string pq_file = param_.get<std::string>("pq_file", param_.get<std::string>("graph_file", "") + ".pq");
+            if (final_index_->LoadPQ(pq_file.c_str(), pq_m))
+            {
+                std::cout << "pq loaded from " << pq_file << std::endl;
+            }
+            else
+            {
+                auto pq_s = std::chrono::high_resolution_clock::now();
+                final_index_->BuildPQ(pq_m, param_.get<unsigned>("pq_sample", 20000), param_.get<unsigned>("pq_iters", 10));
+                std::chrono::duration<double> pq_diff = std::chrono::high_resolution_clock::now() - pq_s;
+                std::cout << "pq train + encode time: " << pq_diff.count() << "s" << std::endl;
+                final_index_->SavePQ(pq_file.c_str());
+                std::cout << "pq saved to " << pq_file << std::endl;
+            }
+        }
+
+        // compressed_graph = 1: 另外生成压缩邻接表 (差分 + StreamVByte 编码的 id 与打包的 alpha 区间),
+        // 增加一种解码遍历的模式, 与 CSR 搜索图比较每个节点的邻接表内存与 QPS
+        const bool compressed_graph = param_.get<unsigned>("compressed_graph", 0) != 0;
+        if (compressed_graph && route_type != ROUTER_DEG)
+        {
+            std::cerr << "compressed_graph is only supported by the DEG router" << std::endl;
+            exit(-1);
+        }
+        if (compressed_graph && !final_index_->hasCompressedAdjacency())
+        {
+            auto adj_s = std::chrono::high_resolution_clock::now();
+            final_index_->BuildCompressedAdjacency();
+            std::chrono::duration<double> adj_diff = std::chrono::high_resolution_clock::now() - adj_s;
+            const double n = std::max<size_t>(final_index_->DEG_search_graph_.size(), 1);
+            std::cout << "compressed adjacency (" << GetAdjacencyDecoder().name << "): "
+                      << final_index_->getCompressedAdjacency().Bytes() / n << " bytes per node, CSR: "
+                      << final_index_->DEG_search_graph_.Bytes() / n << " bytes per node, encode time: "
+                      << adj_diff.count() << "s" << std::endl;
+        }
+
+        // disk_search = 1: SSD 模式, float embedding 与邻接表放在磁盘索引 disk_file (默认 <graph_file>.disk) 中按节点块读取,
+        // 内存只保留坐标与 SQ8 / PQ 编码 (pq_m 非 0 时用 PQ, 否则用 SQ8), 每轮批量读取 disk_beam_width 个块,
+        // 由 disk_io_threads 个 io 线程并行 pread; disk_direct = 1 时用 O_DIRECT 绕过页缓存. 只运行 disk 一种模式
+        const bool disk_search = param_.get<unsigned>("disk_search", 0) != 0;
+        const unsigned disk_beam_width = param_.get<unsigned>("disk_beam_width", 4);
+        if (disk_search)
+        {
+            if (route_type != ROUTER_DEG)
+            {
+                std::cerr << "disk_search is only supported by the DEG router" << std::endl;
+                exit(-1);
+            }
+            if (!sq8 && pq_m == 0)
+            {
+                std::cerr << "disk_search requires sq8 or pq_m for the in-memory codes" << std::endl;
+                exit(-1);
+            }
+            if (final_index_->hasSignCodes() || compressed_graph || numa != "off")
+            {
+                std::cerr << "disk_search cannot be combined with sign_filter, compressed_graph or numa" << std::endl;
+                exit(-1);
+            }
+            if (disk_beam_width == 0 || disk_beam_width > 64)
+            {
+                std::cerr << "disk_beam_width must be in [1, 64]" << std::endl;
+                exit(-1);
+            }
+        }
+        if (disk_search && !final_index_->hasDiskIndex())
+        {
+            const std::string disk_file = param_.get<std::string>("disk_file", param_.get<std::string>("graph_file", "") + ".disk");
+            auto disk_s = std::chrono::high_resolution_clock::now();
+            const bool written = final_index_->OpenDiskIndex(disk_file.c_str(), param_.get<unsigned>("disk_direct", 1) != 0,
+                                                             param_.get<unsigned>("disk_io_threads", 4));
+            std::chrono::duration<double> disk_diff = std::chrono::high_resolution_clock::now() - disk_s;
+            const DiskIndex &disk = final_index_->getDiskIndex();
+            std::cout << "disk index " << (written ? "written to " : "opened from ") << disk_file << ": "
+                      << disk.FileBytes() / 1048576.0 << " MB, " << disk.BlockSize() << " bytes per node block, "
+                      << (disk.direct() ? "O_DIRECT" : "buffered") << ", time: " << disk_diff.count() << "s" << std::endl;
+            std::cout << "in-memory search data: " << final_index_->DiskResidentBytesPerNode() << " bytes per node, beam width: "
+                      << disk_beam_width << std::endl;
+        }
+
+        // 每个 L 依次运行浮点以及已启用的压缩模式, 以便比较 recall / QPS
+        std::vector<std::string> search_modes(1, "float");
+        if (sq8)
+            search_modes.push_back("sq8");
+        if (pq_m != 0)
+            search_modes.push_back("pq");
+        // sign_filter: 符号码在加载时生成, 这里增加一种在当前 embedding 精度上开启预筛的模式
+        if (final_index_->hasSignCodes())
+        {
+            if (route_type != ROUTER_DEG)
+            {
+                std::cerr << "sign_filter is only supported by the DEG router" << std::endl;
+                exit(-1);
+            }
+            search_modes.push_back("sign");
+        }
+        if (compressed_graph)
+            search_modes.push_back("compressed");
+        // SSD 模式下 float embedding 与 CSR 图已释放, 只能运行 disk 模式
+        if (disk_search)
+            search_modes.assign(1, "disk");
+
+        if (numa != "off" && final_index_->getNumaMode() == Index::NUMA_OFF)
+        {
+            auto numa_s = std::chrono::high_resolution_clock::now();
+            const size_t extra = final_index_->PlaceSearchData(numa == "replicate" ? Index::NUMA_REPLICATE : Index::NUMA_INTERLEAVE);
+            std::chrono::duration<double> numa_diff = std::chrono::high_resolution_clock::now() - numa_s;
+            std::cout << "numa: " << numa << " over " << final_index_->getNumaNodes().size() << " node(s), search data "
+                      << final_index_->SearchDataBytes() / 1048576.0 << " MB per copy, extra memory "
+                      << extra / 1048576.0 << " MB, time: " << numa_diff.count() << "s" << std::endl;
+        }
+
         if (L_type == L_SEARCH_ASCEND)
         {
             std::set<unsigned> visited;
@@ -993,53 +1246,84 @@ namespace stkq
                     exit(-1);
                 }
 
-                final_index_->getParam().set<unsigned>("L_search", L);
-
-                auto s1 = std::chrono::high_resolution_clock::now();
-
-                res.clear();
-                res.resize(final_index_->getQueryLen());
-                //  #pragma omp parallel for
-                for (unsigned i = 0; i < final_index_->getQueryLen(); i++)
-                //                for (unsigned i = 0; i < 1000; i++)
-                {
-                    final_index_->set_alpha(final_index_->getQueryWeightData()[i]);
-                    std::vector<Index::Neighbor> pool;
-                    a->SearchEntryInner(i, pool);
-                    b->RouteInner(i, pool, res[i]);
-                }
-                auto e1 = std::chrono::high_resolution_clock::now();
-                std::chrono::duration<double> diff = e1 - s1;
-                std::cout << "search time: " << diff.count() / final_index_->getQueryLen() << "\n";
-                std::cout << "DistCount: " << final_index_->getDistCount() << std::endl;
-                std::cout << "HopCount: " << final_index_->getHopCount() << std::endl;
-                final_index_->resetDistCount();
-                final_index_->resetHopCount();
-                // int cnt = 0;
-                float recall = 0;
-                for (unsigned i = 0; i < final_index_->getQueryLen(); i++)
+                for (unsigned pass = 0; pass < search_modes.size(); pass++)
                 {
-                    if (res[i].size() == 0)
-                        continue;
-                    float tmp_recall = 0;
-                    float cnt = 0;
-                    for (unsigned j = 0; j < K; j++)
+                    // disk 模式用 PQ (pq_m 非 0 时) 或 SQ8 编码遍历
+                    const bool use_disk = search_modes[pass] == "disk";
+                    const bool use_sq8 = search_modes[pass] == "sq8" || (use_disk && pq_m == 0);
+                    const bool use_pq = search_modes[pass] == "pq" || (use_disk && pq_m != 0);
+                    const bool use_sign = search_modes[pass] == "sign";
+                    const bool use_compressed = search_modes[pass] == "compressed";
+                    if (search_modes.size() > 1)
+                        std::cout << "search mode: " << search_modes[pass] << std::endl;
+                    auto s1 = std::chrono::high_resolution_clock::now();
+
+                    res.clear();
+                    res.resize(final_index_->getQueryLen());
+#pragma omp parallel num_threads(search_threads)
                     {
-                        unsigned k = 0;
-                        for (; k < K; k++)
+                        final_index_->PinSearchThread(omp_get_thread_num());
+                        Index::SearchContext *ctx = final_index_->AcquireSearchContext();
+                        Index::SearchResult result;
+#pragma omp for schedule(dynamic, 16)
+                        for (unsigned i = 0; i < final_index_->getQueryLen(); i++)
+                        //                for (unsigned i = 0; i < 1000; i++)
                         {
-                            if (res[i][j] == final_index_->getGroundData()[i * final_index_->getGroundDim() + k])
-                                break;
+                            Index::SearchRequest req = final_index_->MakeSearchRequest(i, final_index_->getQueryWeightData()[i], K, L);
+                            req.budget = search_budget;
+                            req.prefetch_distance = prefetch_distance;
+                            req.sq8 = use_sq8;
+                            req.pq = use_pq;
+                            req.sign_filter = use_sign;
+                            req.compressed_graph = use_compressed;
+                            req.disk_beam_width = use_disk ? disk_beam_width : 0;
+                            ctx->pool.clear();
+                            a->SearchEntryInner(req, ctx->pool);
+                            b->RouteInner(req, ctx, result);
+                            res[i].swap(result.ids);
                         }
-                        if (k == K)
-                            cnt++;
+                        final_index_->ReleaseSearchContext(ctx);
                     }
-                    tmp_recall = (float)(K - cnt) / (float)K;
-                    recall = recall + tmp_recall;
+                    auto e1 = std::chrono::high_resolution_clock::now();
+                    std::chrono::duration<double> diff = e1 - s1;
+                    std::cout << "search time: " << diff.count() / final_index_->getQueryLen() << "\n";
+                    std::cout << "QPS: " << final_index_->getQueryLen() / diff.count() << "\n";
+                    std::cout << "DistCount: " << final_index_->getDistCount() << std::endl;
+                    std::cout << "HopCount: " << final_index_->getHopCount() << std::endl;
+                    if (final_index_->getDimCount() != 0)
+                        std::cout << "DimCount: " << final_index_->getDimCount() << std::endl;
+                    final_index_->resetDistCount();
+                    final_index_->resetHopCount();
+                    if (final_index_->getSignFilteredCount() != 0)
+                        std::cout << "SignFiltered: " << final_index_->getSignFilteredCount() << std::endl;
+                    final_index_->resetDimCount();
+                    final_index_->resetSignFilteredCount();
+                    // int cnt = 0;
+                    float recall = 0;
+                    for (unsigned i = 0; i < final_index_->getQueryLen(); i++)
+                    {
+                        if (res[i].size() == 0)
+                            continue;
+                        float tmp_recall = 0;
+                        float cnt = 0;
+                        for (unsigned j = 0; j < K; j++)
+                        {
+                            unsigned k = 0;
+                            for (; k < K; k++)
+                            {
+                                if (res[i][j] == final_index_->getGroundData()[i * final_index_->getGroundDim() + k])
+                                    break;
+                            }
+                            if (k == K)
+                                cnt++;
+                        }
+                        tmp_recall = (float)(K - cnt) / (float)K;
+                        recall = recall + tmp_recall;
+                    }
+                    // float acc = 1 - (float)cnt / (final_index_->getGroundLen() * K);
+                    float acc = recall / final_index_->getQueryLen();
+                    std::cout << K << " NN accuracy: " << acc << std::endl;
                 }
-                // float acc = 1 - (float)cnt / (final_index_->getGroundLen() * K);
-                float acc = recall / final_index_->getQueryLen();
-                std::cout << K << " NN accuracy: " << acc << std::endl;
             }
         }
         e = std::chrono::high_resolution_clock::now();
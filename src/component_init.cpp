@@ -1100,6 +1100,10 @@ namespace stkq
         int k = 0;
         int l = 0;
 
+        // 每次扩展先收集未访问的邻居, 再一次批量计算它们到 query 的 embedding / 空间距离
+        std::vector<unsigned> fresh;
+        std::vector<float> fresh_e_d, fresh_s_d;
+
         while (k < queue.pool.size())
         {
             while (queue.pool[k].layer_ == l)
@@ -1109,26 +1113,29 @@ namespace stkq
                     queue.pool[k].flag = false;
                     unsigned n = queue.pool[k].id_;
                     Index::DEGNode *candidate_node = index->DEG_nodes_[n];
-                    std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard());
-                    const std::vector<Index::DEGNeighbor> &neighbors = candidate_node->GetFriends();
-                    for (unsigned m = 0; m < neighbors.size(); ++m)
+                    fresh.clear();
                     {
-                        unsigned id = neighbors[m].id_;
-                        if (visited_list->NotVisited(id))
+                        std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard());
+                        const std::vector<Index::DEGNeighbor> &neighbors = candidate_node->GetFriends();
+                        for (unsigned m = 0; m < neighbors.size(); ++m)
                         {
-                            visited_list->MarkAsVisited(id);
-
-                            float e_d = index->get_E_Dist()->compare(index->getBaseEmbData() + (size_t)id * index->getBaseEmbDim(),
-                                                                     index->getBaseEmbData() + (size_t)query * index->getBaseEmbDim(),
-                                                                     index->getBaseEmbDim());
-
-                            float s_d = index->get_S_Dist()->compare(index->getBaseLocData() + (size_t)id * index->getBaseLocDim(),
-                                                                     index->getBaseLocData() + (size_t)query * index->getBaseLocDim(),
-                                                                     index->getBaseLocDim());
-
-                            queue.pool.emplace_back(id, e_d, s_d, true, -1);
+                            unsigned id = neighbors[m].id_;
+                            if (visited_list->NotVisited(id))
+                            {
+                                visited_list->MarkAsVisited(id);
+                                fresh.push_back(id);
+                            }
                         }
                     }
+                    fresh_e_d.resize(fresh.size());
+                    fresh_s_d.resize(fresh.size());
+                    index->HybridDistanceBatch(index->getBaseEmbData() + (size_t)query * index->getBaseEmbDim(),
+                                               index->getBaseLocData() + (size_t)query * index->getBaseLocDim(), 0,
+                                               fresh.data(), fresh.size(), fresh_e_d.data(), fresh_s_d.data());
+                    for (unsigned m = 0; m < fresh.size(); ++m)
+                    {
+                        queue.pool.emplace_back(fresh[m], fresh_e_d[m], fresh_s_d[m], true, -1);
+                    }
                 }
                 k++;
                 if (k >= queue.pool.size())
@@ -2,11 +2,225 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <memory>
 #include <cassert>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "component.h"
 
 namespace stkq
 {
+    // 原生向量文件 (.stkq): 4096 字节的文件头之后是 num 行稠密矩阵, 每行 row_bytes 字节 (末尾补 0 对齐到 alignment).
+    // 数据起点按页对齐, 行内无维数前缀, 可以直接 mmap 后把指针交给 Index
+    static const char kNativeMagic[8] = {'S', 'T', 'K', 'Q', 'V', 'E', 'C', '\0'};
+    static const uint32_t kNativeVersion = 1;
+    static const uint32_t kNativeDataOffset = 4096;
+
+    enum NativeDtype : uint32_t
+    {
+        NATIVE_FLOAT32 = 0,
+        NATIVE_UINT32 = 1
+    };
+
+    // 原生格式的加载方式: OFF 不使用原生文件, MMAP 零拷贝映射文件页, COPY 映射后复制到 AllocAlignedStorage
+    // (文件页为 4KB 页, 不能由大页承载; 随机访问密集时 COPY 的搜索吞吐更高, MMAP 的加载时间与峰值内存更低)
+    enum NativeLoadMode
+    {
+        NATIVE_OFF = 0,
+        NATIVE_MMAP,
+        NATIVE_COPY
+    };
+
+    struct NativeVecsHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t dtype;       // NativeDtype
+        uint64_t num;         // 行数
+        uint32_t dim;         // 每行元素个数
+        uint32_t row_bytes;   // 每行占用的字节数, 不小于 dim * 4
+        uint32_t alignment;   // row_bytes 是 alignment 的倍数
+        uint32_t data_offset; // 第一行在文件中的偏移, 页对齐
+    };
+
+    // 读取 filename 的原生文件头, 不是原生格式时返回 false
+    static bool ReadNativeHeader(const char *filename, NativeVecsHeader &header)
+    {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in.is_open() || !in.read((char *)&header, sizeof(header)))
+            return false;
+        return memcmp(header.magic, kNativeMagic, sizeof(kNativeMagic)) == 0;
+    }
+
+    // 各文件并发加载, 每条日志拼好后整行输出, 避免不同线程的输出交错
+    static void PrintLoaded(const char *verb, unsigned num, const char *filename, unsigned dim, HugePageMode used)
+    {
+        std::ostringstream os;
+        os << verb << " " << num << " entries from " << filename << " with dimension " << dim;
+        if (used != HUGE_PAGE_OFF)
+            os << " (" << (used == HUGE_PAGE_EXPLICIT ? "hugetlb" : "transparent huge pages") << ")";
+        os << "\n";
+#pragma omp critical(load_log)
+        std::cout << os.str() << std::flush;
+    }
+
+    // mmap 原生格式文件, MMAP 模式且行无填充时零拷贝: 先映射一个匿名页加数据区长度的地址范围, 再把文件的数据区按其文件偏移
+    // MAP_FIXED 映射到匿名页之后; 映射信息写在匿名页末尾的 64 字节, 与 AllocAlignedStorage 的布局一致, 同样用 FreeAlignedStorage 释放,
+    // 文件头页不被映射. MAP_PRIVATE 写时复制, 不会改动文件;
+    // 否则只映射数据区, 复制 (并去掉行填充) 到 AllocAlignedStorage. populate 为 true 时用 MAP_POPULATE 在加载时一次读入所有页
+    template <typename T>
+    inline void load_native_data(const char *filename, T *&data, unsigned &num, unsigned &dim, NativeLoadMode mode,
+                                 bool populate, HugePageMode huge_pages)
+    {
+        static_assert(sizeof(T) == 4, "native vector files hold 32-bit elements");
+        NativeVecsHeader header;
+        if (!ReadNativeHeader(filename, header))
+        {
+            std::cerr << "Error reading native header from file " << filename << std::endl;
+            exit(-1);
+        }
+        const uint32_t dtype = std::is_floating_point<T>::value ? NATIVE_FLOAT32 : NATIVE_UINT32;
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        if (header.version != kNativeVersion || header.dtype != dtype || header.row_bytes < header.dim * sizeof(T) ||
+            header.data_offset < sizeof(header) || header.data_offset % page != 0 || header.num == 0 ||
+            header.num > UINT32_MAX)
+        {
+            std::cerr << "Unsupported native header in file " << filename << std::endl;
+            exit(-1);
+        }
+        const size_t payload = header.num * header.row_bytes;
+        int fd = open(filename, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < header.data_offset + payload)
+        {
+            std::cerr << "Error opening or truncated native file " << filename << std::endl;
+            exit(-1);
+        }
+        num = (unsigned)header.num;
+        dim = header.dim;
+        const size_t dense_row = (size_t)dim * sizeof(T);
+        const int flags = MAP_PRIVATE | (populate ? MAP_POPULATE : 0);
+        if (mode == NATIVE_MMAP && header.row_bytes == dense_row)
+        {
+            const size_t length = page + payload;
+            void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            char *rows = p == MAP_FAILED ? nullptr : (char *)p + page;
+            if (p == MAP_FAILED ||
+                mmap(rows, payload, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, (off_t)header.data_offset) == MAP_FAILED)
+            {
+                std::cerr << "Error mapping native file " << filename << std::endl;
+                exit(-1);
+            }
+            close(fd);
+            *(AlignedStorageHeader *)(rows - kStorageAlign) = {p, length};
+            data = (T *)rows;
+            PrintLoaded("Mapped", num, filename, dim, HUGE_PAGE_OFF);
+            return;
+        }
+        void *p = mmap(nullptr, payload, PROT_READ, flags, fd, (off_t)header.data_offset);
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            std::cerr << "Error mapping native file " << filename << std::endl;
+            exit(-1);
+        }
+        const char *rows = (const char *)p;
+        // Index 以 dim 为行距, 有填充的行需要去掉填充
+        HugePageMode used = HUGE_PAGE_OFF;
+        data = (T *)AllocAlignedStorage((size_t)num * dense_row, huge_pages, &used);
+        if (data == nullptr)
+        {
+            std::cerr << "Memory allocation failed for data in " << filename << std::endl;
+            exit(-1);
+        }
+        for (size_t i = 0; i < num; i++)
+            memcpy((char *)data + i * dense_row, rows + i * header.row_bytes, dense_row);
+        munmap(p, payload);
+        PrintLoaded("Loaded", num, filename, dim, used);
+    }
+
+    void ComponentLoad::ConvertToNative(const char *src, const char *dst, unsigned alignment)
+    {
+        if (alignment < 4 || (alignment & (alignment - 1)) != 0 || alignment > kNativeDataOffset)
+        {
+            std::cerr << "alignment must be a power of two in [4, " << kNativeDataOffset << "]" << std::endl;
+            exit(-1);
+        }
+        std::ifstream in(src, std::ios::binary);
+        if (!in.is_open())
+        {
+            std::cerr << "Error opening file " << src << std::endl;
+            exit(-1);
+        }
+        uint32_t dim = 0;
+        in.read((char *)&dim, 4);
+        in.seekg(0, std::ios::end);
+        const size_t f_size = (size_t)in.tellg();
+        if (dim == 0 || f_size % ((size_t)(dim + 1) * 4) != 0)
+        {
+            std::cerr << "File " << src << " is not a valid fvecs / ivecs file" << std::endl;
+            exit(-1);
+        }
+        const std::string src_name(src);
+        NativeVecsHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kNativeMagic, sizeof(kNativeMagic));
+        header.version = kNativeVersion;
+        header.dtype = src_name.size() >= 6 && src_name.compare(src_name.size() - 6, 6, ".ivecs") == 0 ? NATIVE_UINT32 : NATIVE_FLOAT32;
+        header.num = f_size / ((size_t)(dim + 1) * 4);
+        header.dim = dim;
+        header.row_bytes = (dim * 4 + alignment - 1) / alignment * alignment;
+        header.alignment = alignment;
+        header.data_offset = kNativeDataOffset;
+
+        std::ofstream out(dst, std::ios::binary);
+        if (!out.is_open())
+        {
+            std::cerr << "Error creating file " << dst << std::endl;
+            exit(-1);
+        }
+        std::vector<char> page(kNativeDataOffset, 0);
+        memcpy(page.data(), &header, sizeof(header));
+        out.write(page.data(), page.size());
+
+        // 每次读入 block 行 (含维数前缀), 去掉前缀并补齐填充后整块写出
+        in.seekg(0, std::ios::beg);
+        const size_t block = std::max<size_t>(1, (64 << 20) / ((size_t)(dim + 1) * 4));
+        std::vector<char> vecs(block * (dim + 1) * 4);
+        std::vector<char> rows(block * header.row_bytes, 0);
+        for (size_t done = 0; done < header.num;)
+        {
+            const size_t n = std::min<size_t>(block, header.num - done);
+            in.read(vecs.data(), n * (dim + 1) * 4);
+            if (in.fail())
+            {
+                std::cerr << "Error reading data from file " << src << " at index " << done << std::endl;
+                exit(-1);
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                const char *row = vecs.data() + i * (dim + 1) * 4;
+                if (*(const uint32_t *)row != dim)
+                {
+                    std::cerr << "Dimension mismatch in file " << src << " at index " << (done + i) << std::endl;
+                    exit(-1);
+                }
+                memcpy(rows.data() + i * header.row_bytes, row + 4, dim * 4);
+            }
+            out.write(rows.data(), n * header.row_bytes);
+            done += n;
+        }
+        out.close();
+        if (out.fail())
+        {
+            std::cerr << "Error writing file " << dst << std::endl;
+            exit(-1);
+        }
+        std::cout << "Converted " << header.num << " entries with dimension " << dim << " from " << src << " to " << dst
+                  << " (row bytes " << header.row_bytes << ")" << std::endl;
+    }
     // template <typename T>
     // inline void load_data(char *filename, T *&data, unsigned &num, unsigned &dim)
     // {
@@ -40,134 +254,211 @@ namespace stkq
     //     in.close();
     // }
 
+    // 数据按 64 字节对齐分配 (AllocAlignedStorage), 行不填充 (行距为 dim), 维数为 16 的倍数时每一行才是 64 字节对齐的,
+    // 需要用 FreeAlignedStorage 释放; huge_pages 决定不小于 2MB 的数组是否由大页承载
+    // native 不为 OFF 时, filename 本身或旁边的 <filename>.stkq 是原生格式则改用 load_native_data
     template <typename T>
-    inline void load_data(const char *filename, T *&data, unsigned &num, unsigned &dim)
+    inline void load_data(const char *filename, T *&data, unsigned &num, unsigned &dim,
+                          HugePageMode huge_pages = HUGE_PAGE_OFF, NativeLoadMode native = NATIVE_MMAP, bool populate = true)
     {
-        std::ifstream in(filename, std::ios::binary);
-        if (!in.is_open())
+        NativeVecsHeader header;
+        if (native != NATIVE_OFF && ReadNativeHeader(filename, header))
+        {
+            load_native_data(filename, data, num, dim, native, populate, huge_pages);
+            return;
+        }
+        const std::string native_file = std::string(filename) + ".stkq";
+        if (native != NATIVE_OFF && ReadNativeHeader(native_file.c_str(), header))
+        {
+            load_native_data(native_file.c_str(), data, num, dim, native, populate, huge_pages);
+            return;
+        }
+
+        int fd = open(filename, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0)
         {
             std::cerr << "Error opening file " << filename << std::endl;
             exit(-1);
         }
 
         // 读取维度信息
-        in.read((char *)&dim, 4);
-        if (in.fail())
+        if (pread(fd, &dim, 4, 0) != 4)
         {
             std::cerr << "Error reading dimension from file " << filename << std::endl;
             exit(-1);
         }
 
-        // 获取文件大小
-        in.seekg(0, std::ios::end);
-        std::ios::pos_type ss = in.tellg();
-        auto f_size = (size_t)ss;
-
-        // 计算数据数量
-        num = (unsigned)(f_size / (dim + 1) / 4);
+        // 由文件大小计算数据数量
+        const size_t f_size = (size_t)st.st_size;
+        const size_t row_bytes = ((size_t)dim + 1) * 4;
+        num = (unsigned)(f_size / row_bytes);
 
         size_t total_size = (size_t)num * dim;
         // 分配内存
-        try
-        {
-            data = new T[total_size];
-        }
-        catch (std::bad_alloc &)
+        HugePageMode used = HUGE_PAGE_OFF;
+        data = (T *)AllocAlignedStorage(total_size * sizeof(T), huge_pages, &used);
+        if (data == nullptr)
         {
             std::cerr << "Memory allocation failed for data in " << filename << std::endl;
             exit(-1);
         }
 
-        in.seekg(0, std::ios::beg);
-        // 分块读取数据
-        const size_t block_size = 10000 * dim; // 每次读取10000个数据块，可以根据需要调整
-        size_t offset = 0;
-
-        while (offset < total_size)
+        // 按 1MB 左右的字节区间切块, 每个块作为一个 OpenMP task 用 pread 读入该 task 自己的缓冲区 (留在 L2 中),
+        // 缓冲区随 task 结束释放, 不会在每个 OpenMP 线程上常驻;
+        // 校验每行的维数前缀后把数据部分复制到目标位置; 各块互不重叠, 由所在线程首次写入.
+        // 在 LoadInner 的并行区中调用时与其他文件的块共用同一组线程, 单独调用时顺序执行
+        const size_t chunk_rows = std::max<size_t>(1, (1 << 20) / row_bytes);
+        const size_t chunks = (num + chunk_rows - 1) / chunk_rows;
+        size_t bad_row = SIZE_MAX; // 出错的最小行号
+        bool read_error = false;
+#pragma omp taskloop grainsize(1) shared(bad_row, read_error)
+        for (size_t c = 0; c < chunks; c++)
         {
-            size_t remaining = total_size - offset;
-            size_t current_block_size = std::min(block_size, remaining);
-
-            for (size_t i = 0; i < current_block_size / dim; ++i)
+            const size_t begin = c * chunk_rows, rows = std::min<size_t>(chunk_rows, num - begin);
+            const size_t bytes = rows * row_bytes;
+            std::unique_ptr<char[]> buffer(new char[bytes]);
+            size_t done = 0;
+            while (done < bytes)
             {
-                // 读取并验证维度信息
-                unsigned current_dim;
-                in.read(reinterpret_cast<char *>(&current_dim), sizeof(current_dim));
-                if (in.fail() || current_dim != dim)
-                {
-                    std::cerr << "Error reading dimension or dimension mismatch in file " << filename << " at index " << (offset / dim + i) << std::endl;
-                    delete[] data;
-                    exit(-1);
-                }
-
-                in.read(reinterpret_cast<char *>(data + offset + i * dim), dim * sizeof(T));
-                if (in.fail())
+                ssize_t r = pread(fd, buffer.get() + done, bytes - done, (off_t)(begin * row_bytes + done));
+                if (r <= 0)
+                    break;
+                done += (size_t)r;
+            }
+            size_t bad = done < bytes ? begin + done / row_bytes : SIZE_MAX;
+            for (size_t i = 0; i < rows && begin + i < bad; i++)
+            {
+                const char *row = buffer.get() + i * row_bytes;
+                if (*(const uint32_t *)row != dim)
+                    bad = begin + i;
+                else
+                    memcpy(data + (begin + i) * dim, row + 4, dim * sizeof(T));
+            }
+            if (bad != SIZE_MAX)
+            {
+#pragma omp critical(load_error)
                 {
-                    std::cerr << "Error reading data from file " << filename << " at index " << (offset / dim + i) << std::endl;
-                    delete[] data;
-                    exit(-1);
+                    read_error = read_error || done < bytes;
+                    bad_row = std::min(bad_row, bad);
                 }
             }
-
-            offset += current_block_size;
         }
-
-        in.close();
+        close(fd);
+        if (bad_row != SIZE_MAX)
+        {
+            std::cerr << "Error reading dimension or dimension mismatch in file " << filename << " at index " << bad_row
+                      << (read_error ? " (read error)" : "") << std::endl;
+            FreeAlignedStorage(data);
+            exit(-1);
+        }
 
         // 输出调试信息
-        std::cout << "Loaded " << num << " entries from " << filename << " with dimension " << dim << std::endl;
+        PrintLoaded("Loaded", num, filename, dim, used);
     }
 
     void ComponentLoad::LoadInner(char *data_emb_file, char *data_loc_file, char *query_emb_file, char *query_loc_file, char *query_alpha_file, char *ground_file,
                                   Parameters &parameters)
     {
+        // huge_pages = off / thp / explicit: base embedding 与坐标的大页策略, 默认 thp
+        // 图上随机游走时 4KB 页的 TLB 覆盖范围远小于 base 数据, 大页可以减少 TLB miss
+        const std::string huge_pages_param = parameters.get<std::string>("huge_pages", "thp");
+        HugePageMode huge_pages = HUGE_PAGE_TRANSPARENT;
+        if (huge_pages_param == "off")
+            huge_pages = HUGE_PAGE_OFF;
+        else if (huge_pages_param == "explicit")
+            huge_pages = HUGE_PAGE_EXPLICIT;
+        else if (huge_pages_param != "thp")
+        {
+            std::cerr << "unknown huge_pages: " << huge_pages_param << std::endl;
+            exit(-1);
+        }
+        // native_data = mmap (默认) / copy / off: 存在原生格式文件 (见 ConvertToNative) 时的加载方式, 见 NativeLoadMode;
+        // mmap_populate = 1 (默认) 时加载阶段一次性读入所有页, 0 时首次访问才从文件读入
+        const std::string native_param = parameters.get<std::string>("native_data", "mmap");
+        NativeLoadMode native = NATIVE_MMAP;
+        if (native_param == "copy")
+            native = NATIVE_COPY;
+        else if (native_param == "off")
+            native = NATIVE_OFF;
+        else if (native_param != "mmap")
+        {
+            std::cerr << "unknown native_data: " << native_param << std::endl;
+            exit(-1);
+        }
+        const bool populate = parameters.get<unsigned>("mmap_populate", 1) != 0;
+        auto load_s = std::chrono::high_resolution_clock::now();
+        // 六个文件各作为一个 task 并发加载, 文件内部再按字节区间拆成 task (见 load_data), 共用 n_threads 个线程
+        float *data_emb = nullptr, *data_loc = nullptr, *query_emb = nullptr, *query_loc = nullptr, *query_alpha = nullptr;
+        unsigned *ground_data = nullptr;
+        unsigned n{}, emb_dim{}, loc_n{}, loc_dim{}, query_num{}, query_emb_dim{}, query_loc_num{}, query_loc_dim{};
+        unsigned query_alpha_num{}, query_alpha_dim{}, ground_num{}, ground_dim{};
+#pragma omp parallel num_threads(parameters.get<unsigned>("n_threads", omp_get_max_threads()))
+#pragma omp single
+        {
+#pragma omp task shared(data_emb, n, emb_dim)
+            load_data<float>(data_emb_file, data_emb, n, emb_dim, huge_pages, native, populate);
+#pragma omp task shared(data_loc, loc_n, loc_dim)
+            load_data<float>(data_loc_file, data_loc, loc_n, loc_dim, huge_pages, native, populate);
+#pragma omp task shared(query_emb, query_num, query_emb_dim)
+            load_data<float>(query_emb_file, query_emb, query_num, query_emb_dim, HUGE_PAGE_OFF, native, populate);
+#pragma omp task shared(query_loc, query_loc_num, query_loc_dim)
+            load_data(query_loc_file, query_loc, query_loc_num, query_loc_dim, HUGE_PAGE_OFF, native, populate);
+#pragma omp task shared(query_alpha, query_alpha_num, query_alpha_dim)
+            load_data(query_alpha_file, query_alpha, query_alpha_num, query_alpha_dim, HUGE_PAGE_OFF, native, populate);
+#pragma omp task shared(ground_data, ground_num, ground_dim)
+            load_data<unsigned>(ground_file, ground_data, ground_num, ground_dim, HUGE_PAGE_OFF, native, populate);
+        }
         // base_emb_data
-        float *data_emb = nullptr;
-        unsigned n{};
-        unsigned emb_dim{};
-        load_data<float>(data_emb_file, data_emb, n, emb_dim);
         index->setBaseEmbData(data_emb);
         index->setBaseLen(n);
         index->setBaseEmbDim(emb_dim);
         assert(index->getBaseEmbData() != nullptr && index->getBaseLen() != 0 && index->getBaseEmbDim() != 0);
-        float *data_loc = nullptr;
-        unsigned loc_n{};
-        unsigned loc_dim{};
-        load_data<float>(data_loc_file, data_loc, loc_n, loc_dim);
         index->setBaseLocData(data_loc);
         index->setBaseLocDim(loc_dim);
         assert(index->getBaseLocData() != nullptr && loc_n == index->getBaseLen());
         // query_emb_data
-        float *query_emb = nullptr;
-        unsigned query_num{};
-        unsigned query_emb_dim{};
-        load_data<float>(query_emb_file, query_emb, query_num, query_emb_dim);
         index->setQueryEmbData(query_emb);
         index->setQueryLen(query_num);
         index->setQueryEmbDim(query_emb_dim);
         assert(index->getQueryEmbData() != nullptr && index->getQueryLen() != 0 && index->getQueryEmbDim() != 0);
         assert(index->getBaseEmbDim() == index->getQueryEmbDim());
-        float *query_loc = nullptr;
-        unsigned query_loc_num{};
-        unsigned query_loc_dim{};
-        load_data(query_loc_file, query_loc, query_loc_num, query_loc_dim);
         index->setQueryLocData(query_loc);
         index->setQueryLocDim(query_loc_dim);
         assert(query_loc_num == index->getQueryLen() && query_loc_dim == index->getBaseLocDim());
-        float *query_alpha = nullptr;
-        unsigned query_alpha_num{};
-        unsigned query_alpha_dim{};
-        load_data(query_alpha_file, query_alpha, query_alpha_num, query_alpha_dim);
         index->setQueryWeightData(query_alpha);
         assert(query_loc_num == index->getQueryLen());
-        unsigned *ground_data = nullptr;
-        unsigned ground_num{};
-        unsigned ground_dim{};
-        load_data<unsigned>(ground_file, ground_data, ground_num, ground_dim);
         index->setGroundData(ground_data);
         index->setGroundLen(ground_num);
         index->setGroundDim(ground_dim);
         assert(index->getGroundData() != nullptr && index->getGroundLen() != 0 && index->getGroundDim() != 0);
+        std::chrono::duration<double> load_diff = std::chrono::high_resolution_clock::now() - load_s;
+        std::cout << "data load time: " << load_diff.count() << "s" << std::endl;
         index->setParam(parameters);
+        // sign_filter: 加载时为 base embedding 生成符号码并校准距离估计, 需在转为半精度之前完成
+        if (parameters.get<unsigned>("sign_filter", 0) != 0)
+        {
+            auto sign_s = std::chrono::high_resolution_clock::now();
+            index->BuildSignCodes();
+            index->CalibrateSignFilter(parameters.get<float>("sign_quantile", 0.01), parameters.get<unsigned>("sign_sample", 200));
+            std::chrono::duration<double> sign_diff = std::chrono::high_resolution_clock::now() - sign_s;
+            std::cout << "sign codes: " << index->getBaseEmbDim() << " bits, ratio: " << index->getSignRatio()
+                      << ", time: " << sign_diff.count() << "s" << std::endl;
+        }
+        // emb_precision = fp16 / bf16 时 base embedding 加载后立即转为半精度, 内存与带宽减半 (query 仍为 float)
+        const std::string emb_precision = parameters.get<std::string>("emb_precision", "float");
+        if (emb_precision == "fp16" || emb_precision == "bf16")
+        {
+            index->ConvertBaseEmbToHalf(emb_precision == "fp16" ? EMB_FLOAT16 : EMB_BFLOAT16, huge_pages != HUGE_PAGE_OFF);
+            std::cout << "base embedding stored as " << emb_precision << std::endl;
+        }
+        else if (emb_precision != "float")
+        {
+            std::cerr << "unknown emb_precision: " << emb_precision << std::endl;
+            exit(-1);
+        }
+        // 维数确定后一次性选定按维数特化的距离 kernel, 之后的建图与搜索都直接调用特化版本
+        index->get_E_Dist()->specialize(index->getBaseEmbDim());
+        index->get_S_Dist()->specialize(index->getBaseLocDim());
     }
 }
\ No newline at end of file
@@ -2,18 +2,22 @@
 
 namespace stkq
 {
-    void ComponentSearchRouteGreedy::RouteInner(unsigned int query, std::vector<Index::Neighbor> &pool,
-                                                std::vector<unsigned int> &res)
+    void ComponentSearchRouteGreedy::RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx,
+                                                Index::SearchResult &res)
     {
-        const auto L = index->getParam().get<unsigned>("L_search");
+        const float alpha = req.alpha;
+        const auto L = req.L;
         // 搜索过程中考虑的候选点数量 ef_search
-        const auto K = index->getParam().get<unsigned>("K_search");
+        const auto K = req.K;
         // 最终需要返回的近邻数量
-        std::vector<char> flags(index->getBaseLen(), 0);
-        // 创建一个标志数组flags，用于标记已经访问过的点，避免重复处理。数组大小与数据集的基础长度（index->getBaseLen()）相同
+        ctx->BeginQuery();
+        std::vector<Index::Neighbor> &pool = ctx->pool;
+        Index::VisitedList *visited_list = &ctx->visited_list;
+        visited_list->Reset();
+        // 使用线程复用的 visited_list 标记已经访问过的点，避免重复处理，同时省去每个查询 O(N) 的清零
         int k = 0;
         // 使用变量k从头到L遍历候选池pool中的点
-        while (k < (int)L)
+        while (k < (int)L && !ctx->OverBudget(req))
         {
             int nk = L;
 
@@ -22,27 +26,27 @@ namespace stkq
                 pool[k].flag = false;
                 unsigned n = pool[k].id;
                 // 遍历当前点n的所有邻居。
-                // 使用flags数组检查每个邻居是否已经被访问过，若未访问则标记为已访问
-                index->addHopCount();
+                // 使用visited_list检查每个邻居是否已经被访问过，若未访问则标记为已访问
+                ctx->hop_count++;
                 for (unsigned m = 0; m < index->getLoadGraph()[n].size(); ++m)
                 {
                     unsigned id = index->getLoadGraph()[n][m];
 
-                    if (flags[id])
+                    if (visited_list->Visited(id))
                         continue;
-                    flags[id] = 1;
+                    visited_list->MarkAsVisited(id);
 
-                    float e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)query * index->getBaseEmbDim(),
+                    float e_d = index->get_E_Dist()->compare(req.query_emb,
                                                              index->getBaseEmbData() + (size_t)id * index->getBaseEmbDim(),
                                                              index->getBaseEmbDim());
 
-                    float s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)query * index->getBaseLocDim(),
+                    float s_d = index->get_S_Dist()->compare(req.query_loc,
                                                              index->getBaseLocData() + (size_t)id * index->getBaseLocDim(),
                                                              index->getBaseLocDim());
 
-                    float dist = index->get_alpha() * e_d + (1 - index->get_alpha()) * s_d;
+                    float dist = alpha * e_d + (1 - alpha) * s_d;
 
-                    index->addDistCount();
+                    ctx->dist_count++;
 
                     if (dist >= pool[L - 1].distance)
                         continue;
@@ -75,32 +79,34 @@ namespace stkq
             }
         }
 
-        res.resize(K);
+        res.ids.resize(K);
+        res.distances.resize(K);
         for (size_t i = 0; i < K; i++)
         {
-            res[i] = pool[i].id;
+            res.ids[i] = pool[i].id;
+            res.distances[i] = pool[i].distance;
         }
     }
 
-    void ComponentSearchRouteHNSW::RouteInner(unsigned int query, std::vector<Index::Neighbor> &pool,
-                                              std::vector<unsigned int> &res)
+    void ComponentSearchRouteHNSW::RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx,
+                                              Index::SearchResult &res)
     {
 
-        const auto K = index->getParam().get<unsigned>("K_search"); // 获取K_search参数来确定搜索结果的数量
-
-        // const auto L = index->getParam().get<unsigned>("L_search");
+        const float alpha = req.alpha;
+        const bool frozen = index->isFrozen();
+        const auto K = req.K; // 搜索结果的数量
+        ctx->BeginQuery();
 
-        auto *visited_list = new Index::VisitedList(index->getBaseLen()); // 初始化一个VisitedList对象来跟踪已访问的节点
+        Index::VisitedList *visited_list = &ctx->visited_list; // 复用线程 SearchContext 中的 VisitedList 来跟踪已访问的节点
 
         Index::HnswNode *enterpoint = index->enterpoint_;
-        std::vector<std::pair<Index::HnswNode *, float>> ensure_k_path_; // 记录在每一层找到的最近节点及其距离
+        std::vector<std::pair<Index::HnswNode *, float>> &ensure_k_path_ = ctx->hnsw_path; // 记录在每一层找到的最近节点及其距离
 
         Index::HnswNode *cur_node = enterpoint;
-        float alpha = index->get_alpha();
         float e_d, s_d;
         if (alpha != 0)
         {
-            e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)query * index->getBaseEmbDim(),
+            e_d = index->get_E_Dist()->compare(req.query_emb,
                                                index->getBaseEmbData() + (size_t)cur_node->GetId() * index->getBaseEmbDim(),
                                                index->getBaseEmbDim());
         }
@@ -111,7 +117,7 @@ namespace stkq
 
         if (alpha != 1)
         {
-            s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)query * index->getBaseLocDim(),
+            s_d = index->get_S_Dist()->compare(req.query_loc,
                                                index->getBaseLocData() + (size_t)cur_node->GetId() * index->getBaseLocDim(),
                                                index->getBaseLocDim());
         }
@@ -122,7 +128,7 @@ namespace stkq
 
         float d = alpha * e_d + (1 - alpha) * s_d;
 
-        index->addDistCount();
+        ctx->dist_count++;
         float cur_dist = d;
 
         ensure_k_path_.clear();
@@ -139,10 +145,12 @@ namespace stkq
             while (changed)
             {
                 changed = false;
-                std::unique_lock<std::mutex> local_lock(cur_node->GetAccessGuard());
+                std::unique_lock<std::mutex> local_lock(cur_node->GetAccessGuard(), std::defer_lock);
+                if (!frozen)
+                    local_lock.lock();
                 const std::vector<Index::HnswNode *> &neighbors = cur_node->GetFriends(i);
 
-                index->addHopCount();
+                ctx->hop_count++;
                 for (auto iter = neighbors.begin(); iter != neighbors.end(); ++iter)
                 {
                     if (visited[(*iter)->GetId()] != visited_mark)
@@ -151,7 +159,7 @@ namespace stkq
 
                         if (alpha != 0)
                         {
-                            e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)query * index->getBaseEmbDim(),
+                            e_d = index->get_E_Dist()->compare(req.query_emb,
                                                                index->getBaseEmbData() + (size_t)(*iter)->GetId() * index->getBaseEmbDim(),
                                                                index->getBaseEmbDim());
                         }
@@ -162,7 +170,7 @@ namespace stkq
                         if (alpha != 1)
                         {
 
-                            s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)query * index->getBaseLocDim(),
+                            s_d = index->get_S_Dist()->compare(req.query_loc,
                                                                index->getBaseLocData() + (size_t)(*iter)->GetId() * index->getBaseLocDim(),
                                                                index->getBaseLocDim());
                         }
@@ -172,7 +180,7 @@ namespace stkq
                         }
                         d = alpha * e_d + (1 - alpha) * s_d;
 
-                        index->addDistCount();
+                        ctx->dist_count++;
                         if (d < cur_dist)
                         {
                             cur_dist = d;
@@ -185,13 +193,15 @@ namespace stkq
             }
         }
 
-        std::priority_queue<Index::FurtherFirst> result;
-        std::priority_queue<Index::CloserFirst> tmp;
+        auto &result = ctx->hnsw_result;
+        auto &tmp = ctx->hnsw_sorted;
+        result.clear();
+        tmp.clear();
 
         while (result.size() < K && !ensure_k_path_.empty())
         {
             cur_dist = ensure_k_path_.back().second;
-            SearchAtLayer(query, ensure_k_path_.back().first, 0, visited_list, result);
+            SearchAtLayer(req, ensure_k_path_.back().first, 0, ctx, result);
             ensure_k_path_.pop_back();
         }
 
@@ -201,33 +211,36 @@ namespace stkq
             result.pop();
         }
 
-        res.resize(K);
+        res.ids.assign(K, 0);
+        res.distances.assign(K, INF_P);
         int pos = 0;
         while (!tmp.empty() && pos < K)
         {
-            auto *top_node = tmp.top().GetNode();
+            res.ids[pos] = tmp.top().GetNode()->GetId();
+            res.distances[pos] = tmp.top().GetDistance();
             tmp.pop();
-            res[pos] = top_node->GetId();
             pos++;
         }
-
-        delete visited_list;
     }
 
-    void ComponentSearchRouteHNSW::SearchAtLayer(unsigned qnode, Index::HnswNode *enterpoint, int level,
-                                                 Index::VisitedList *visited_list,
+    void ComponentSearchRouteHNSW::SearchAtLayer(const Index::SearchRequest &req, Index::HnswNode *enterpoint, int level,
+                                                 Index::SearchContext *ctx,
                                                  std::priority_queue<Index::FurtherFirst> &result)
     {
-        const auto L = index->getParam().get<unsigned>("L_search");
+        const float alpha = req.alpha;
+        const bool frozen = index->isFrozen();
+        const auto L = req.L;
+        const unsigned prefetch_distance = req.prefetch_distance;
 
         // TODO: check Node 12bytes => 8bytes
-        std::priority_queue<Index::CloserFirst> candidates;
+        Index::VisitedList *visited_list = &ctx->visited_list;
+        auto &candidates = ctx->hnsw_candidates;
+        candidates.clear();
 
-        float alpha = index->get_alpha();
         float e_d, s_d;
         if (alpha != 0)
         {
-            e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
+            e_d = index->get_E_Dist()->compare(req.query_emb,
                                                index->getBaseEmbData() + (size_t)enterpoint->GetId() * index->getBaseEmbDim(),
                                                index->getBaseEmbDim());
         }
@@ -239,7 +252,7 @@ namespace stkq
         if (alpha != 1)
         {
 
-            s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
+            s_d = index->get_S_Dist()->compare(req.query_loc,
                                                index->getBaseLocData() + (size_t)enterpoint->GetId() * index->getBaseLocDim(),
                                                index->getBaseLocDim());
         }
@@ -249,14 +262,14 @@ namespace stkq
         }
         float d = alpha * e_d + (1 - alpha) * s_d;
 
-        index->addDistCount();
+        ctx->dist_count++;
         result.emplace(enterpoint, d);
         candidates.emplace(enterpoint, d);
 
         visited_list->Reset();
         visited_list->MarkAsVisited(enterpoint->GetId());
 
-        while (!candidates.empty())
+        while (!candidates.empty() && !ctx->OverBudget(req))
         {
             const Index::CloserFirst &candidate = candidates.top();
             float lower_bound = result.top().GetDistance();
@@ -264,19 +277,36 @@ namespace stkq
                 break;
 
             Index::HnswNode *candidate_node = candidate.GetNode();
-            std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard());
+            std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard(), std::defer_lock);
+            if (!frozen)
+                lock.lock();
             const std::vector<Index::HnswNode *> &neighbors = candidate_node->GetFriends(level);
             candidates.pop();
-            index->addHopCount();
-            for (const auto &neighbor : neighbors)
+            ctx->hop_count++;
+            if (prefetch_distance > 0)
             {
+                if (!candidates.empty())
+                    _mm_prefetch((const char *)candidates.top().GetNode()->GetFriends(level).data(), _MM_HINT_T0);
+                for (size_t j = 0; j < neighbors.size() && j < prefetch_distance; j++)
+                    index->PrefetchBaseData(neighbors[j]->GetId());
+            }
+            for (size_t j = 0; j < neighbors.size(); j++)
+            {
+                // 计算当前邻居的距离前, 预取 prefetch_distance 之后那个未访问邻居的向量
+                if (j + prefetch_distance < neighbors.size() && prefetch_distance > 0)
+                {
+                    const unsigned next_id = neighbors[j + prefetch_distance]->GetId();
+                    if (visited_list->NotVisited(next_id))
+                        index->PrefetchBaseData(next_id);
+                }
+                Index::HnswNode *neighbor = neighbors[j];
                 int id = neighbor->GetId();
                 if (visited_list->NotVisited(id))
                 {
                     visited_list->MarkAsVisited(id);
                     if (alpha != 0)
                     {
-                        e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
+                        e_d = index->get_E_Dist()->compare(req.query_emb,
                                                            index->getBaseEmbData() + (size_t)neighbor->GetId() * index->getBaseEmbDim(),
                                                            index->getBaseEmbDim());
                     }
@@ -286,7 +316,7 @@ namespace stkq
                     }
                     if (alpha != 1)
                     {
-                        s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
+                        s_d = index->get_S_Dist()->compare(req.query_loc,
                                                            index->getBaseLocData() + (size_t)neighbor->GetId() * index->getBaseLocDim(),
                                                            index->getBaseLocDim());
                     }
@@ -296,7 +326,7 @@ namespace stkq
                     }
                     d = alpha * e_d + (1 - alpha) * s_d;
 
-                    index->addDistCount();
+                    ctx->dist_count++;
                     if (result.size() < L || result.top().GetDistance() > d)
                     {
                         result.emplace(neighbor, d);
@@ -309,53 +339,61 @@ namespace stkq
         }
     }
 
-    void ComponentSearchRouteDEG::RouteInner(unsigned int query, std::vector<Index::Neighbor> &pool,
-                                             std::vector<unsigned int> &res)
+    void ComponentSearchRouteDEG::RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx,
+                                             Index::SearchResult &res)
     {
-        const auto K = index->getParam().get<unsigned>("K_search");
-        auto *visited_list = new Index::VisitedList(index->getBaseLen());
-        float alpha = index->get_alpha();
-        visited_list->Reset();
-        unsigned visited_mark = visited_list->GetVisitMark();
-        unsigned int *visited = visited_list->GetVisited();
+        const auto K = req.K;
+        ctx->BeginQuery();
 
-        std::priority_queue<Index::DEG_FurtherFirst> result;
-        std::priority_queue<Index::DEG_CloserFirst> tmp;
+        res.ids.assign(K, 0);
+        res.distances.assign(K, INF_P);
+        if (req.disk_beam_width > 0)
+        {
+            const unsigned expanded = SearchDisk(req, ctx);
+            for (unsigned pos = 0; pos < expanded && pos < K; pos++)
+            {
+                res.ids[pos] = index->getExternalId(ctx->disk_expanded[pos].id);
+                res.distances[pos] = ctx->disk_expanded[pos].distance;
+            }
+            return;
+        }
 
-        // while (result.size() < K && !ensure_k_path_.empty())
-        // {
-        // cur_dist = ensure_k_path_.back().second;
-        SearchAtLayer(query, index->DEG_enterpoint_, 0, visited_list, result);
-        // ensure_k_path_.pop_back();
-        // }
+        // 候选集本身按距离升序, 前 K 个即为结果, 不再需要额外的堆来排序
+        std::vector<Index::Neighbor> &pool = ctx->deg_pool;
+        unsigned pool_size = SearchAtLayer(req, index->DEG_enterpoint_, 0, ctx, pool);
 
-        while (!result.empty())
+        // SQ8 / PQ 遍历得到的候选集用原始浮点 embedding 重新计算距离并排序
+        if (req.sq8 || req.pq)
         {
-            tmp.push(Index::DEG_CloserFirst(result.top().GetNode(), result.top().GetEmbDistance(), result.top().GetLocDistance(), result.top().GetDistance()));
-            result.pop();
+            for (unsigned i = 0; i < pool_size; i++)
+            {
+                const unsigned id = pool[i].id;
+                float e_d = index->get_E_Dist()->compare(req.query_emb, ctx->data.emb + (size_t)id * index->getBaseEmbDim(),
+                                                         index->getBaseEmbDim());
+                float s_d = index->get_S_Dist()->compare(req.query_loc, ctx->data.loc + (size_t)id * index->getBaseLocDim(),
+                                                         index->getBaseLocDim());
+                ctx->dist_count++;
+                pool[i].distance = req.alpha * e_d + (1 - req.alpha) * s_d;
+            }
+            std::sort(pool.begin(), pool.begin() + pool_size);
         }
 
-        res.resize(K);
-        int pos = 0;
-        while (!tmp.empty() && pos < K)
+        for (unsigned pos = 0; pos < pool_size && pos < K; pos++)
         {
-            auto *top_node = tmp.top().GetNode();
-            tmp.pop();
-            res[pos] = top_node->GetId();
-            pos++;
+            res.ids[pos] = index->getExternalId(pool[pos].id);
+            res.distances[pos] = pool[pos].distance;
         }
-
-        delete visited_list;
     }
-    void ComponentSearchRouteBS4::RouteInner(unsigned int query, std::vector<Index::Neighbor> &pool,
-                                             std::vector<unsigned int> &res)
+    void ComponentSearchRouteBS4::RouteInner(const Index::SearchRequest &req, Index::SearchContext *ctx,
+                                             Index::SearchResult &res)
     {
 
-        const auto K = index->getParam().get<unsigned>("K_search"); // 获取K_search参数来确定搜索结果的数量
+        const float alpha = req.alpha;
+        const bool frozen = index->isFrozen();
+        const auto K = req.K; // 搜索结果的数量
+        ctx->BeginQuery();
 
-        auto *visited_list = new Index::VisitedList(index->getBaseLen()); // 初始化一个VisitedList对象来跟踪已访问的节点
-
-        float alpha = index->get_alpha();
+        Index::VisitedList *visited_list = &ctx->visited_list; // 复用线程 SearchContext 中的 VisitedList 来跟踪已访问的节点
 
         int index_count = 0;
 
@@ -381,13 +419,13 @@ namespace stkq
         }
 
         Index::BS4Node *enterpoint = index->baseline4_enterpoint_[index_count];
-        std::vector<std::pair<Index::BS4Node *, float>> ensure_k_path_; // 记录在每一层找到的最近节点及其距离
+        std::vector<std::pair<Index::BS4Node *, float>> &ensure_k_path_ = ctx->bs4_path; // 记录在每一层找到的最近节点及其距离
 
         Index::BS4Node *cur_node = enterpoint;
         float e_d, s_d;
         if (alpha != 0)
         {
-            e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)query * index->getBaseEmbDim(),
+            e_d = index->get_E_Dist()->compare(req.query_emb,
                                                index->getBaseEmbData() + (size_t)cur_node->GetId() * index->getBaseEmbDim(),
                                                index->getBaseEmbDim());
         }
@@ -398,7 +436,7 @@ namespace stkq
 
         if (alpha != 1)
         {
-            s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)query * index->getBaseLocDim(),
+            s_d = index->get_S_Dist()->compare(req.query_loc,
                                                index->getBaseLocData() + (size_t)cur_node->GetId() * index->getBaseLocDim(),
                                                index->getBaseLocDim());
         }
@@ -408,7 +446,7 @@ namespace stkq
         }
 
         float d = alpha * e_d + (1 - alpha) * s_d;
-        index->addDistCount();
+        ctx->dist_count++;
         float cur_dist = d;
 
         ensure_k_path_.clear();
@@ -425,10 +463,12 @@ namespace stkq
             while (changed)
             {
                 changed = false;
-                std::unique_lock<std::mutex> local_lock(cur_node->GetAccessGuard());
+                std::unique_lock<std::mutex> local_lock(cur_node->GetAccessGuard(), std::defer_lock);
+                if (!frozen)
+                    local_lock.lock();
                 const std::vector<Index::BS4Node *> &neighbors = cur_node->GetFriends(i);
 
-                index->addHopCount();
+                ctx->hop_count++;
                 for (auto iter = neighbors.begin(); iter != neighbors.end(); ++iter)
                 {
                     if (visited[(*iter)->GetId()] != visited_mark)
@@ -437,7 +477,7 @@ namespace stkq
 
                         if (alpha != 0)
                         {
-                            e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)query * index->getBaseEmbDim(),
+                            e_d = index->get_E_Dist()->compare(req.query_emb,
                                                                index->getBaseEmbData() + (size_t)(*iter)->GetId() * index->getBaseEmbDim(),
                                                                index->getBaseEmbDim());
                         }
@@ -448,7 +488,7 @@ namespace stkq
                         if (alpha != 1)
                         {
 
-                            s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)query * index->getBaseLocDim(),
+                            s_d = index->get_S_Dist()->compare(req.query_loc,
                                                                index->getBaseLocData() + (size_t)(*iter)->GetId() * index->getBaseLocDim(),
                                                                index->getBaseLocDim());
                         }
@@ -458,7 +498,7 @@ namespace stkq
                         }
                         d = alpha * e_d + (1 - alpha) * s_d;
 
-                        index->addDistCount();
+                        ctx->dist_count++;
                         if (d < cur_dist)
                         {
                             cur_dist = d;
@@ -474,13 +514,15 @@ namespace stkq
         // std::cout << "ensure_k : " << ensure_k_path_.size() << " " << ensure_k_path_[0].first->GetId() << std::endl;
 
         // std::vector<std::pair<Index::HnswNode*, float>> tmp;
-        std::priority_queue<Index::BS4FurtherFirst> result;
-        std::priority_queue<Index::BS4CloserFirst> tmp;
+        auto &result = ctx->bs4_result;
+        auto &tmp = ctx->bs4_sorted;
+        result.clear();
+        tmp.clear();
 
         while (result.size() < K && !ensure_k_path_.empty())
         {
             cur_dist = ensure_k_path_.back().second;
-            SearchAtLayer(query, ensure_k_path_.back().first, 0, visited_list, result);
+            SearchAtLayer(req, ensure_k_path_.back().first, 0, ctx, result);
             ensure_k_path_.pop_back();
         }
 
@@ -490,33 +532,34 @@ namespace stkq
             result.pop();
         }
 
-        res.resize(K);
+        res.ids.assign(K, 0);
+        res.distances.assign(K, INF_P);
         int pos = 0;
         while (!tmp.empty() && pos < K)
         {
-            auto *top_node = tmp.top().GetNode();
+            res.ids[pos] = tmp.top().GetNode()->GetId();
+            res.distances[pos] = tmp.top().GetDistance();
             tmp.pop();
-            res[pos] = top_node->GetId();
             pos++;
         }
-
-        delete visited_list;
     }
 
-    void ComponentSearchRouteBS4::SearchAtLayer(unsigned qnode, Index::BS4Node *enterpoint, int level,
-                                                Index::VisitedList *visited_list,
+    void ComponentSearchRouteBS4::SearchAtLayer(const Index::SearchRequest &req, Index::BS4Node *enterpoint, int level,
+                                                Index::SearchContext *ctx,
                                                 std::priority_queue<Index::BS4FurtherFirst> &result)
     {
-        const auto L = index->getParam().get<unsigned>("L_search");
+        const float alpha = req.alpha;
+        const bool frozen = index->isFrozen();
+        const auto L = req.L;
         // TODO: check Node 12bytes => 8bytes
-        std::priority_queue<Index::BS4CloserFirst> candidates;
+        Index::VisitedList *visited_list = &ctx->visited_list;
+        auto &candidates = ctx->bs4_candidates;
+        candidates.clear();
 
-        float alpha = index->get_alpha();
-        // exit(1);
         float e_d, s_d;
         if (alpha != 0)
         {
-            e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
+            e_d = index->get_E_Dist()->compare(req.query_emb,
                                                index->getBaseEmbData() + (size_t)enterpoint->GetId() * index->getBaseEmbDim(),
                                                index->getBaseEmbDim());
         }
@@ -528,7 +571,7 @@ namespace stkq
         if (alpha != 1)
         {
 
-            s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
+            s_d = index->get_S_Dist()->compare(req.query_loc,
                                                index->getBaseLocData() + (size_t)enterpoint->GetId() * index->getBaseLocDim(),
                                                index->getBaseLocDim());
         }
@@ -538,13 +581,13 @@ namespace stkq
         }
         float d = alpha * e_d + (1 - alpha) * s_d;
 
-        index->addDistCount();
+        ctx->dist_count++;
         result.emplace(enterpoint, d);
         candidates.emplace(enterpoint, d);
         visited_list->Reset();
         visited_list->MarkAsVisited(enterpoint->GetId());
 
-        while (!candidates.empty())
+        while (!candidates.empty() && !ctx->OverBudget(req))
         {
             const Index::BS4CloserFirst &candidate = candidates.top();
             float lower_bound = result.top().GetDistance();
@@ -552,10 +595,12 @@ namespace stkq
                 break;
 
             Index::BS4Node *candidate_node = candidate.GetNode();
-            std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard());
+            std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard(), std::defer_lock);
+            if (!frozen)
+                lock.lock();
             const std::vector<Index::BS4Node *> &neighbors = candidate_node->GetFriends(level);
             candidates.pop();
-            index->addHopCount();
+            ctx->hop_count++;
             for (const auto &neighbor : neighbors)
             {
                 int id = neighbor->GetId();
@@ -564,7 +609,7 @@ namespace stkq
                     visited_list->MarkAsVisited(id);
                     if (alpha != 0)
                     {
-                        e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
+                        e_d = index->get_E_Dist()->compare(req.query_emb,
                                                            index->getBaseEmbData() + (size_t)neighbor->GetId() * index->getBaseEmbDim(),
                                                            index->getBaseEmbDim());
                     }
@@ -574,7 +619,7 @@ namespace stkq
                     }
                     if (alpha != 1)
                     {
-                        s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
+                        s_d = index->get_S_Dist()->compare(req.query_loc,
                                                            index->getBaseLocData() + (size_t)neighbor->GetId() * index->getBaseLocDim(),
                                                            index->getBaseLocDim());
                     }
@@ -584,7 +629,7 @@ namespace stkq
                     }
                     d = alpha * e_d + (1 - alpha) * s_d;
 
-                    index->addDistCount();
+                    ctx->dist_count++;
                     if (result.size() < L || result.top().GetDistance() > d)
                     {
                         result.emplace(neighbor, d);
@@ -597,208 +642,434 @@ namespace stkq
         }
     }
 
-    void ComponentSearchRouteDEG::SearchAtLayer(unsigned qnode, Index::DEGNode *enterpoint, int level,
-                                                Index::VisitedList *visited_list,
-                                                std::priority_queue<Index::DEG_FurtherFirst> &result)
+    // query 到 base 点 id 的 embedding 距离, 超过 bound 时返回 false (浮点路径会提前终止)
+    // SQ8 模式下用量化编码的整数距离近似, PQ 模式下用 ADC 查表近似, 最终结果在 RouteInner 中用浮点距离重排;
+    // base embedding 以 fp16 / bf16 存储时直接在半精度数据上计算, 不再重排
+    // 按 req 启用的编码预先处理 query, 在遍历之前调用
+    void ComponentSearchRouteDEG::EncodeQuery(const Index::SearchRequest &req, Index::SearchContext *ctx)
     {
-        const auto L = index->getParam().get<unsigned>("L_search");
+        // SQ8 模式下先把 query 量化, 遍历时与 base 编码做整数距离
+        if (req.sq8)
+        {
+            ctx->query_code.resize(index->getBaseEmbDim());
+            index->EncodeSQ8(req.query_emb, ctx->query_code.data());
+        }
+        if (req.sign_filter)
+        {
+            ctx->query_sign.resize(index->getSignWords());
+            index->EncodeSign(req.query_emb, ctx->query_sign.data(), ctx->query_sign_norm);
+        }
+        // PQ 模式下先算出 query 的 ADC 距离表, 每个邻居的 embedding 距离只需 M 次查表
+        if (req.pq)
+        {
+            ctx->pq_table.resize((size_t)index->getPQ().M() * PQCodec::KSUB);
+            index->getPQ().ComputeTable(req.query_emb, ctx->pq_table.data());
+        }
+    }
 
-        std::priority_queue<Index::DEG_CloserFirst> candidates;
-        float alpha = index->get_alpha();
+    bool ComponentSearchRouteDEG::EmbDistance(const Index::SearchRequest &req, Index::SearchContext *ctx, unsigned id,
+                                              float bound, float &e_d)
+    {
+        // 符号码预筛: 估计距离乘以校准系数后仍不小于 bound 时视同提前终止, 不再计算完整距离
+        if (req.sign_filter && bound < INF_P &&
+            index->get_E_Dist()->from_sqr(index->getSignRatio() *
+                                          index->EstimateEmbSqrDist(ctx->query_sign.data(), ctx->query_sign_norm, id)) >= bound)
+        {
+            ctx->sign_filtered++;
+            return false;
+        }
+        if (req.pq)
+        {
+            e_d = index->get_E_Dist()->from_sqr(index->getPQ().SqrDistance(ctx->pq_table.data(), index->getPQCode(id)));
+            return e_d < bound;
+        }
+        if (req.sq8)
+        {
+            e_d = index->get_E_Dist()->compare_sq8(ctx->query_code.data(), index->getSQ8Code(id),
+                                                   index->getBaseEmbDim(), index->getSQ8Step());
+            ctx->dim_count += index->getBaseEmbDim();
+            return e_d < bound;
+        }
+        if (index->getEmbPrecision() != EMB_FLOAT32)
+        {
+            e_d = index->get_E_Dist()->compare_half(req.query_emb, ctx->data.emb_half + (size_t)id * index->getBaseEmbDim(),
+                                                    index->getBaseEmbDim(), index->getEmbPrecision());
+            ctx->dim_count += index->getBaseEmbDim();
+            return e_d < bound;
+        }
+        unsigned scanned;
+        bool complete = index->get_E_Dist()->compare_bounded(req.query_emb, ctx->data.emb + (size_t)id * index->getBaseEmbDim(),
+                                                             index->getBaseEmbDim(), bound, e_d, scanned, req.emb_aligned);
+        ctx->dim_count += scanned;
+        return complete;
+    }
+
+    unsigned ComponentSearchRouteDEG::SearchAtLayer(const Index::SearchRequest &req, Index::DEGNode *enterpoint, int level,
+                                                    Index::SearchContext *ctx, std::vector<Index::Neighbor> &pool)
+    {
+        const float alpha = req.alpha;
+        const Index::DEGSearchGraph::AlphaMask alpha_mask = Index::DEGSearchGraph::MakeAlphaMask(alpha * 100);
+        // 入口点全部进入候选集, 候选集容量至少为入口点个数
+        const unsigned L = std::max<unsigned>(req.L, index->enterpoint_set.size());
+        // 搜索图与 base 数据从 ctx->data 读取, NUMA replicate 模式下为本节点的副本
+        const Index::DEGSearchGraph &search_graph = *ctx->data.graph;
+
+        const unsigned prefetch_distance = req.prefetch_distance;
+        unsigned *fresh = ctx->fresh_ids;
+        unsigned *fresh_edges = ctx->fresh_edges;
+        // 压缩邻接表: 扩展节点时解码出对当前 alpha 有效的邻居 (按 id 升序), 其中不含内联坐标
+        const CompressedAdjacency *adjacency = req.compressed_graph ? &index->getCompressedAdjacency() : nullptr;
+        if (adjacency != nullptr && ctx->adjacency_ids.size() < adjacency->MaxDegree())
+            ctx->adjacency_ids.resize(adjacency->MaxDegree());
+        // 二维坐标已内联在邻接表中时, 扩展节点只读取 embedding, 不再预取 base_loc_data_
+        const bool inline_locs = adjacency == nullptr && search_graph.HasInlineLocs();
+        float *fresh_loc_dist = ctx->fresh_loc_dist;
+
+        Index::VisitedList *visited_list = &ctx->visited_list;
         visited_list->Reset();
 
+        EncodeQuery(req, ctx);
+
+        // pool 按混合距离升序保存当前最好的至多 L 个点, flag 为 true 表示尚未扩展
+        if (pool.size() < (size_t)L + 1)
+            pool.resize(L + 1);
+        unsigned pool_size = 0;
+
         bool m_first = false;
 
         for (int i = 0; i < index->enterpoint_set.size(); i++)
         {
-            Index::DEGNode *cur_node = index->DEG_nodes_[index->enterpoint_set[i]];
+            const unsigned cur_id = index->enterpoint_set[i];
 
-            float cur_e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
-                                                         index->getBaseEmbData() + (size_t)cur_node->GetId() * index->getBaseEmbDim(),
-                                                         index->getBaseEmbDim());
+            float cur_e_d;
+            EmbDistance(req, ctx, cur_id, INF_P, cur_e_d);
 
-            index->addDistCount();
+            ctx->dist_count++;
 
-            float cur_s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
-                                                         index->getBaseLocData() + (size_t)cur_node->GetId() * index->getBaseLocDim(),
+            float cur_s_d = index->get_S_Dist()->compare(req.query_loc,
+                                                         ctx->data.loc + (size_t)cur_id * index->getBaseLocDim(),
                                                          index->getBaseLocDim());
-            index->addDistCount();
+            ctx->dist_count++;
 
             float cur_dist = alpha * cur_e_d + (1 - alpha) * cur_s_d;
 
-            result.emplace(cur_node, cur_e_d, cur_s_d, cur_dist);
-            candidates.emplace(cur_node, cur_e_d, cur_s_d, cur_dist);
+            Index::InsertIntoBoundedPool(pool.data(), pool_size, L, Index::Neighbor(cur_id, cur_dist, true));
 
-            visited_list->MarkAsVisited(cur_node->GetId());
+            visited_list->MarkAsVisited(cur_id);
         }
 
-        while (!candidates.empty())
+        // k 指向最近的未扩展点, 与 ComponentSearchRouteGreedy 相同的游标式扩展
+        unsigned k = 0;
+        while (k < pool_size && !ctx->OverBudget(req))
         {
-            const Index::DEG_CloserFirst &candidate = candidates.top();
-            float lower_bound = result.top().GetDistance();
-            if (candidate.GetDistance() > lower_bound)
-                break;
-
-            Index::DEGNode *candidate_node = candidate.GetNode();
-            std::unique_lock<std::mutex> lock(candidate_node->GetAccessGuard());
-            std::vector<Index::DEGSimpleNeighbor> &neighbors = candidate_node->GetSearchFriends();
-            candidates.pop();
-            index->addHopCount();
-            for (const auto &neighbor : neighbors)
+            if (!pool[k].flag)
+            {
+                ++k;
+                continue;
+            }
+            pool[k].flag = false;
+            unsigned nk = pool_size;
+
+            // CSR 搜索图在加载后只读, 扩展节点时不需要加锁
+            const unsigned candidate_id = pool[k].id;
+            size_t edge_begin = 0, edge_end;
+            if (adjacency != nullptr)
+                edge_end = adjacency->DecodeActive(candidate_id, alpha_mask.alpha100, ctx->adjacency_ids.data());
+            else
+            {
+                edge_begin = search_graph.EdgeBegin(candidate_id);
+                edge_end = search_graph.EdgeEnd(candidate_id);
+            }
+            ctx->hop_count++;
+            if (prefetch_distance > 0 && k + 1 < pool_size && pool[k + 1].flag)
             {
-                int neighbor_id = neighbor.id_;
-                // const std::vector<std::pair<float, float>> &use_range = neighbor.available_range;
-                // bool search_flag = false;
-                // for (int i = 0; i < use_range.size(); i++)
-                // {
-                //     if (alpha >= use_range[i].first && alpha <= use_range[i].second)
-                //     {
-                //         search_flag = true;
-                //         break;
-                //     }
-                //     if (alpha < use_range[i].first)
-                //     {
-                //         break;
-                //     }
-                //     if (alpha > use_range[i].second)
-                //     {
-                //         continue;
-                //     }
-                // }
-                const std::vector<std::pair<int8_t, int8_t>> &use_range = neighbor.active_range;
-                bool search_flag = false;
-                for (int i = 0; i < use_range.size(); i++)
+                if (adjacency != nullptr)
+                    adjacency->Prefetch(pool[k + 1].id);
+                else
+                    search_graph.Prefetch(pool[k + 1].id);
+            }
+            // 每次取出至多 64 条边的有效位掩码, 只遍历对当前 alpha 有效的邻居
+            for (size_t base = edge_begin; base < edge_end; base += 64)
+            {
+                // 先收集本段中未访问过的有效邻居, 再在计算距离的同时预取后面邻居的向量
+                unsigned fresh_num = 0;
+                if (adjacency != nullptr)
                 {
-                    if (alpha * 100 >= use_range[i].first && alpha * 100 <= use_range[i].second)
+                    for (size_t e = base; e < std::min<size_t>(base + 64, edge_end); e++)
                     {
-                        search_flag = true;
-                        break;
+                        const unsigned id = ctx->adjacency_ids[e];
+                        if (visited_list->NotVisited(id))
+                        {
+                            visited_list->MarkAsVisited(id);
+                            fresh[fresh_num++] = id;
+                        }
                     }
-                    if (alpha * 100 < use_range[i].first)
+                }
+                else
+                {
+                    uint64_t active = search_graph.ActiveMask(base, (unsigned)std::min<size_t>(64, edge_end - base), alpha_mask);
+                    while (active)
                     {
-                        break;
+                        const size_t e = base + __builtin_ctzll(active);
+                        active &= active - 1;
+                        const unsigned id = search_graph.ids[e];
+                        if (visited_list->NotVisited(id))
+                        {
+                            visited_list->MarkAsVisited(id);
+                            fresh_edges[fresh_num] = (unsigned)e;
+                            fresh[fresh_num++] = id;
+                        }
                     }
-                    if (alpha * 100 > use_range[i].second)
+                }
+                // 空间距离维度低, 对整段邻居一次批量计算; embedding 距离仍逐个计算以便按阈值提前剪枝
+                if (inline_locs)
+                    index->get_S_Dist()->compare_batch(search_graph.locs.data(), 2, req.query_loc, fresh_edges, fresh_num,
+                                                       fresh_loc_dist);
+                else
+                    index->get_S_Dist()->compare_batch(ctx->data.loc, index->getBaseLocDim(), req.query_loc,
+                                                       fresh, fresh_num, fresh_loc_dist);
+                // 候选集已满时阈值只会变小, 空间距离部分已超过阈值的邻居之后也不会入选 (与下面逐个判断的结果相同),
+                // 先剔除它们, 只有剩下的邻居才预取并计算 embedding
+                if (pool_size >= L && (m_first || alpha <= 0.5))
+                {
+                    const float threshold = pool[L - 1].distance;
+                    unsigned kept = 0;
+                    for (unsigned j = 0; j < fresh_num; j++)
                     {
-                        continue;
+                        if ((1 - alpha) * fresh_loc_dist[j] < threshold)
+                        {
+                            fresh[kept] = fresh[j];
+                            fresh_loc_dist[kept++] = fresh_loc_dist[j];
+                        }
                     }
+                    fresh_num = kept;
                 }
+                for (unsigned j = 0; j < fresh_num && j < prefetch_distance; j++)
+                    index->PrefetchBaseData(ctx->data, fresh[j], req.sq8, req.pq, !inline_locs);
 
-                // search_flag = true;
-
-                if (search_flag)
+                for (unsigned j = 0; j < fresh_num; j++)
                 {
-                    if (visited_list->NotVisited(neighbor_id))
-                    {
-                        visited_list->MarkAsVisited(neighbor_id);
+                    if (j + prefetch_distance < fresh_num)
+                        index->PrefetchBaseData(ctx->data, fresh[j + prefetch_distance], req.sq8, req.pq, !inline_locs);
+                    int neighbor_id = fresh[j];
 
-                        if (result.size() >= L)
+                    if (pool_size >= L)
+                    {
+                        if (m_first)
                         {
-                            if (m_first)
+                            float threshold = pool[L - 1].distance;
+
+                            float s_d = fresh_loc_dist[j];
+
+                            if ((1 - alpha) * s_d >= threshold)
+                            {
+                                continue;
+                            }
+
+                            // embedding 距离超过剩余预算 (threshold - (1 - alpha) * s_d) / alpha 时提前终止
+                            float e_d;
+                            const float bound = alpha > 0 ? (threshold - (1 - alpha) * s_d) / alpha : INF_P;
+                            bool complete = EmbDistance(req, ctx, neighbor_id, bound, e_d);
+                            ctx->dist_count++;
+                            if (!complete)
+                                continue;
+
+                            float d = alpha * e_d + (1 - alpha) * s_d;
+
+                            if (threshold > d)
                             {
-                                float threshold = result.top().GetDistance();
+                                int r = Index::InsertIntoBoundedPool(pool.data(), pool_size, L, Index::Neighbor(neighbor_id, d, true));
+                                if ((unsigned)r < nk)
+                                    nk = r;
+                            }
+                        }
+                        else
+                        {
+                            float threshold = pool[L - 1].distance;
 
-                                float s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
-                                                                         index->getBaseLocData() + (size_t)neighbor_id * index->getBaseLocDim(),
-                                                                         index->getBaseLocDim());
+                            if (alpha <= 0.5)
+                            {
+                                float s_d = fresh_loc_dist[j];
 
                                 if ((1 - alpha) * s_d >= threshold)
                                 {
                                     continue;
                                 }
 
-                                float e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
-                                                                         index->getBaseEmbData() + (size_t)neighbor_id * index->getBaseEmbDim(),
-                                                                         index->getBaseEmbDim());
-                                index->addDistCount();
+                                // embedding 距离超过剩余预算 (threshold - (1 - alpha) * s_d) / alpha 时提前终止
+                                float e_d;
+                                const float bound = alpha > 0 ? (threshold - (1 - alpha) * s_d) / alpha : INF_P;
+                                bool complete = EmbDistance(req, ctx, neighbor_id, bound, e_d);
+                                ctx->dist_count++;
+                                if (!complete)
+                                    continue;
 
                                 float d = alpha * e_d + (1 - alpha) * s_d;
 
                                 if (threshold > d)
                                 {
-                                    result.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                                    candidates.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                                    if (result.size() > L)
-                                        result.pop();
+                                    int r = Index::InsertIntoBoundedPool(pool.data(), pool_size, L, Index::Neighbor(neighbor_id, d, true));
+                                    if ((unsigned)r < nk)
+                                        nk = r;
                                 }
                             }
                             else
                             {
-                                float threshold = result.top().GetDistance();
+                                float s_d = fresh_loc_dist[j];
 
-                                if (alpha <= 0.5)
+                                float e_d;
+                                bool complete = EmbDistance(req, ctx, neighbor_id, (threshold - (1 - alpha) * s_d) / alpha, e_d);
+
+                                if (!complete || alpha * e_d >= threshold)
                                 {
-                                    float s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
-                                                                             index->getBaseLocData() + (size_t)neighbor_id * index->getBaseLocDim(),
-                                                                             index->getBaseLocDim());
-
-                                    if ((1 - alpha) * s_d >= threshold)
-                                    {
-                                        continue;
-                                    }
-
-                                    float e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
-                                                                             index->getBaseEmbData() + (size_t)neighbor_id * index->getBaseEmbDim(),
-                                                                             index->getBaseEmbDim());
-                                    index->addDistCount();
-
-                                    float d = alpha * e_d + (1 - alpha) * s_d;
-
-                                    if (threshold > d)
-                                    {
-                                        result.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                                        candidates.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                                        if (result.size() > L)
-                                            result.pop();
-                                    }
+                                    continue;
                                 }
-                                else
+
+                                ctx->dist_count++;
+
+                                float d = alpha * e_d + (1 - alpha) * s_d;
+
+                                if (threshold > d)
                                 {
-                                    float e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
-                                                                             index->getBaseEmbData() + (size_t)neighbor_id * index->getBaseEmbDim(),
-                                                                             index->getBaseEmbDim());
-
-                                    if (alpha * e_d >= threshold)
-                                    {
-                                        continue;
-                                    }
-
-                                    float s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
-                                                                             index->getBaseLocData() + (size_t)neighbor_id * index->getBaseLocDim(),
-                                                                             index->getBaseLocDim());
-
-                                    index->addDistCount();
-
-                                    float d = alpha * e_d + (1 - alpha) * s_d;
-
-                                    if (threshold > d)
-                                    {
-                                        result.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                                        candidates.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                                        if (result.size() > L)
-                                            result.pop();
-                                    }
+                                    int r = Index::InsertIntoBoundedPool(pool.data(), pool_size, L, Index::Neighbor(neighbor_id, d, true));
+                                    if ((unsigned)r < nk)
+                                        nk = r;
                                 }
                             }
                         }
-                        else
-                        {
-                            float s_d = index->get_S_Dist()->compare(index->getQueryLocData() + (size_t)qnode * index->getBaseLocDim(),
-                                                                     index->getBaseLocData() + (size_t)neighbor_id * index->getBaseLocDim(),
-                                                                     index->getBaseLocDim());
+                    }
+                    else
+                    {
+                        float s_d = fresh_loc_dist[j];
+
+                        float e_d;
+                        EmbDistance(req, ctx, neighbor_id, INF_P, e_d);
+                        float d = alpha * e_d + (1 - alpha) * s_d;
+                        int r = Index::InsertIntoBoundedPool(pool.data(), pool_size, L, Index::Neighbor(neighbor_id, d, true));
+                        if ((unsigned)r < nk)
+                            nk = r;
+                    }
+                }
+            }
+            // 有更近的点插入到 k 之前时回退游标, 否则继续向后
+            if (nk <= k)
+                k = nk;
+            else
+                ++k;
+        }
+        return pool_size;
+    }
 
-                            float e_d = index->get_E_Dist()->compare(index->getQueryEmbData() + (size_t)qnode * index->getBaseEmbDim(),
-                                                                     index->getBaseEmbData() + (size_t)neighbor_id * index->getBaseEmbDim(),
-                                                                     index->getBaseEmbDim());
-                            float d = alpha * e_d + (1 - alpha) * s_d;
-                            result.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                            candidates.emplace(index->DEG_nodes_[neighbor_id], e_d, s_d, d);
-                            if (result.size() > L)
-                                result.pop();
+    // SSD 模式: 候选集 pool 按编码 (SQ8 / PQ) 的近似 embedding 距离与内存中坐标的精确空间距离排序,
+    // 每轮取出其中最近的至多 W 个未扩展点, 一次批量读取它们的磁盘块. 块中的 float embedding 给出精确混合距离,
+    // 记入 disk_expanded 作为最终候选; 块中的邻接记录解码出对当前 alpha 有效的邻居, 与内存搜索一样剪枝后加入候选集.
+    // 候选集中没有未扩展点时结束
+    unsigned ComponentSearchRouteDEG::SearchDisk(const Index::SearchRequest &req, Index::SearchContext *ctx)
+    {
+        const float alpha = req.alpha;
+        const float alpha100 = Index::DEGSearchGraph::MakeAlphaMask(alpha * 100).alpha100;
+        const unsigned L = std::max<unsigned>(req.L, index->enterpoint_set.size());
+        const unsigned W = req.disk_beam_width;
+        const unsigned emb_dim = index->getBaseEmbDim();
+        const unsigned loc_dim = index->getBaseLocDim();
+        const DiskIndex &disk = index->getDiskIndex();
+        const AdjacencyDecoder &decoder = GetAdjacencyDecoder();
+
+        // O_DIRECT 要求读取的目标地址按块对齐
+        if (ctx->disk_block_num < W)
+        {
+            ctx->disk_blocks.reset((char *)aligned_alloc(DiskIndex::kBlockAlign, (size_t)W * disk.BlockSize()));
+            ctx->disk_block_num = W;
+        }
+        ctx->disk_ids.resize(W);
+        if (ctx->adjacency_ids.size() < disk.header().max_degree)
+            ctx->adjacency_ids.resize(disk.header().max_degree);
+        ctx->disk_expanded.clear();
+        unsigned *fresh = ctx->fresh_ids;
+        float *fresh_loc_dist = ctx->fresh_loc_dist;
+
+        Index::VisitedList *visited_list = &ctx->visited_list;
+        visited_list->Reset();
+
+        EncodeQuery(req, ctx);
+
+        std::vector<Index::Neighbor> &pool = ctx->deg_pool;
+        if (pool.size() < (size_t)L + 1)
+            pool.resize(L + 1);
+        unsigned pool_size = 0;
+
+        for (const unsigned cur_id : index->enterpoint_set)
+        {
+            float cur_e_d;
+            EmbDistance(req, ctx, cur_id, INF_P, cur_e_d);
+            float cur_s_d = index->get_S_Dist()->compare(req.query_loc, ctx->data.loc + (size_t)cur_id * loc_dim, loc_dim);
+            ctx->dist_count += 2;
+            Index::InsertIntoBoundedPool(pool.data(), pool_size, L,
+                                         Index::Neighbor(cur_id, alpha * cur_e_d + (1 - alpha) * cur_s_d, true));
+            visited_list->MarkAsVisited(cur_id);
+        }
+
+        while (!ctx->OverBudget(req))
+        {
+            unsigned n = 0;
+            for (unsigned i = 0; i < pool_size && n < W; i++)
+            {
+                if (pool[i].flag)
+                {
+                    pool[i].flag = false;
+                    ctx->disk_ids[n++] = pool[i].id;
+                }
+            }
+            if (n == 0)
+                break;
+            disk.Read(ctx->disk_ids.data(), n, ctx->disk_blocks.get());
+            ctx->hop_count += n;
+
+            for (unsigned b = 0; b < n; b++)
+            {
+                const char *block = ctx->disk_blocks.get() + (size_t)b * disk.BlockSize();
+                const unsigned id = ctx->disk_ids[b];
+                const float e_d = index->get_E_Dist()->compare(req.query_emb, disk.BlockEmb(block), emb_dim);
+                const float s_d = index->get_S_Dist()->compare(req.query_loc, ctx->data.loc + (size_t)id * loc_dim, loc_dim);
+                ctx->dist_count++;
+                ctx->disk_expanded.emplace_back(id, alpha * e_d + (1 - alpha) * s_d, false);
+
+                const unsigned degree = CompressedAdjacency::DecodeRecord(disk.BlockRecord(block), alpha100,
+                                                                          ctx->adjacency_ids.data(), decoder);
+                for (unsigned base = 0; base < degree; base += 64)
+                {
+                    unsigned fresh_num = 0;
+                    for (unsigned e = base; e < std::min(base + 64, degree); e++)
+                    {
+                        const unsigned neighbor_id = ctx->adjacency_ids[e];
+                        if (visited_list->NotVisited(neighbor_id))
+                        {
+                            visited_list->MarkAsVisited(neighbor_id);
+                            fresh[fresh_num++] = neighbor_id;
                         }
                     }
+                    index->get_S_Dist()->compare_batch(ctx->data.loc, loc_dim, req.query_loc, fresh, fresh_num, fresh_loc_dist);
+                    for (unsigned j = 0; j < fresh_num; j++)
+                    {
+                        const float threshold = pool_size >= L ? pool[L - 1].distance : INF_P;
+                        const float neighbor_s_d = fresh_loc_dist[j];
+                        if ((1 - alpha) * neighbor_s_d >= threshold)
+                            continue;
+                        float neighbor_e_d;
+                        const float bound = alpha > 0 ? (threshold - (1 - alpha) * neighbor_s_d) / alpha : INF_P;
+                        const bool complete = EmbDistance(req, ctx, fresh[j], bound, neighbor_e_d);
+                        ctx->dist_count++;
+                        if (!complete)
+                            continue;
+                        const float d = alpha * neighbor_e_d + (1 - alpha) * neighbor_s_d;
+                        if (d < threshold)
+                            Index::InsertIntoBoundedPool(pool.data(), pool_size, L, Index::Neighbor(fresh[j], d, true));
+                    }
                 }
             }
         }
+
+        std::sort(ctx->disk_expanded.begin(), ctx->disk_expanded.end());
+        return ctx->disk_expanded.size();
     }
-}
\ No newline at end of file
+}
@@ -6,10 +6,10 @@
 
 namespace stkq
 {
-    void ComponentSearchEntryCentroid::SearchEntryInner(unsigned int query, std::vector<Index::Neighbor> &pool)
+    void ComponentSearchEntryCentroid::SearchEntryInner(const Index::SearchRequest &req, std::vector<Index::Neighbor> &pool)
     {
-        const auto L = index->getParam().get<unsigned>("L_search");
-        pool.reserve(L + 1);
+        const auto L = req.L;
+        pool.resize(L + 1);
         std::vector<unsigned> init_ids(L);
         boost::dynamic_bitset<> flags{index->getBaseLen(), 0};
 
@@ -35,14 +35,14 @@ namespace stkq
             unsigned id = init_ids[i];
 
             float e_d = index->get_E_Dist()->compare(index->getBaseEmbData() + (size_t)id * index->getBaseEmbDim(),
-                                                     index->getBaseEmbData() + (size_t)query * index->getQueryEmbDim(),
+                                                     req.query_emb,
                                                      index->getBaseEmbDim());
 
             float s_d = index->get_S_Dist()->compare(index->getBaseLocData() + (size_t)id * index->getBaseLocDim(),
-                                                     index->getBaseLocData() + (size_t)query * index->getBaseLocDim(),
+                                                     req.query_loc,
                                                      index->getBaseLocDim());
 
-            float dist = index->get_alpha() * e_d + (1 - index->get_alpha()) * s_d;
+            float dist = req.alpha * e_d + (1 - req.alpha) * s_d;
 
             index->addDistCount();
             pool[i] = Index::Neighbor(id, dist, true);
@@ -52,6 +52,6 @@ namespace stkq
         std::sort(pool.begin(), pool.begin() + L);
     }
 
-    void ComponentSearchEntryNone::SearchEntryInner(unsigned int query, std::vector<Index::Neighbor> &pool) {}
+    void ComponentSearchEntryNone::SearchEntryInner(const Index::SearchRequest &req, std::vector<Index::Neighbor> &pool) {}
 
 }
@@ -0,0 +1,241 @@
+#include "disk.h"
+#include "adjacency.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace stkq
+{
+    static const char kDiskMagic[8] = {'S', 'T', 'K', 'Q', 'D', 'S', 'K', '\0'};
+    static const uint32_t kDiskVersion = 1;
+
+    BlockReader::BlockReader(int fd, size_t block_size, size_t data_offset, unsigned threads)
+        : fd_(fd), block_size_(block_size), data_offset_(data_offset)
+    {
+        for (unsigned t = 0; t < threads; t++)
+            threads_.emplace_back(&BlockReader::Worker, this);
+    }
+
+    BlockReader::~BlockReader()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto &t : threads_)
+            t.join();
+    }
+
+    void BlockReader::ReadBlock(unsigned id, char *dst) const
+    {
+        const off_t offset = (off_t)(data_offset_ + (size_t)id * block_size_);
+        size_t done = 0;
+        while (done < block_size_)
+        {
+            ssize_t r = pread(fd_, dst + done, block_size_ - done, offset + done);
+            if (r <= 0)
+            {
+                std::cerr << "disk index read error at block " << id << std::endl;
+                exit(-1);
+            }
+            done += (size_t)r;
+        }
+    }
+
+    void BlockReader::RunBatch(Batch &batch)
+    {
+        unsigned i;
+        while ((i = batch.next.fetch_add(1)) < batch.n)
+        {
+            ReadBlock(batch.ids[i], batch.buffer + (size_t)i * block_size_);
+            if (batch.done.fetch_add(1) + 1 == batch.n)
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                done_cv_.notify_all();
+            }
+        }
+    }
+
+    void BlockReader::Worker()
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        while (true)
+        {
+            work_cv_.wait(guard, [this]()
+                          { return stop_ || !queue_.empty(); });
+            if (stop_)
+                return;
+            Batch *batch = queue_.front();
+            if (batch->next.load() >= batch->n)
+            {
+                queue_.pop_front();
+                continue;
+            }
+            batch->users++;
+            guard.unlock();
+            RunBatch(*batch);
+            guard.lock();
+            // 调用线程在 users 归零前不会释放 batch
+            if (--batch->users == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    void BlockReader::Read(const unsigned *ids, unsigned n, char *buffer)
+    {
+        Batch batch;
+        batch.ids = ids;
+        batch.n = n;
+        batch.buffer = buffer;
+        const bool share = !threads_.empty() && n > 1;
+        if (share)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                queue_.push_back(&batch);
+            }
+            work_cv_.notify_all();
+        }
+        RunBatch(batch);
+        if (share)
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            auto it = std::find(queue_.begin(), queue_.end(), &batch);
+            if (it != queue_.end())
+                queue_.erase(it);
+            done_cv_.wait(guard, [&batch]()
+                          { return batch.done.load() == batch.n && batch.users.load() == 0; });
+        }
+    }
+
+    uint64_t DiskIndex::GraphHash(size_t node_num, const size_t *offsets, const unsigned *ids)
+    {
+        // FNV-1a, 依次混入每个节点的出度与邻居 id
+        uint64_t h = 1469598103934665603ULL;
+        auto mix = [&h](uint64_t v)
+        {
+            h ^= v;
+            h *= 1099511628211ULL;
+        };
+        for (size_t u = 0; u < node_num; u++)
+        {
+            mix(offsets[u + 1] - offsets[u]);
+            for (size_t e = offsets[u]; e < offsets[u + 1]; e++)
+                mix(ids[e]);
+        }
+        return h;
+    }
+
+    void DiskIndex::Write(const char *file, size_t node_num, const float *emb, unsigned emb_dim, const size_t *offsets,
+                          const unsigned *ids, const unsigned *range_offsets, const std::pair<int8_t, int8_t> *ranges)
+    {
+        // 先编码全部记录以确定块大小: embedding + 最长的记录 + 16 字节 (SIMD 解码的越界读取), 按 4096 对齐
+        std::vector<uint8_t> records;
+        std::vector<size_t> record_offsets(node_num + 1, 0);
+        Header header{};
+        for (size_t u = 0; u < node_num; u++)
+        {
+            CompressedAdjacency::EncodeRecord(offsets[u], offsets[u + 1], ids, range_offsets, ranges, records);
+            record_offsets[u + 1] = records.size();
+            header.max_degree = std::max<uint32_t>(header.max_degree, offsets[u + 1] - offsets[u]);
+        }
+        size_t max_record = 0;
+        for (size_t u = 0; u < node_num; u++)
+            max_record = std::max(max_record, record_offsets[u + 1] - record_offsets[u]);
+
+        memcpy(header.magic, kDiskMagic, sizeof(header.magic));
+        header.version = kDiskVersion;
+        header.emb_dim = emb_dim;
+        header.node_num = node_num;
+        header.edge_num = offsets[node_num];
+        header.graph_hash = GraphHash(node_num, offsets, ids);
+        header.block_size = ((size_t)emb_dim * sizeof(float) + max_record + 16 + kBlockAlign - 1) / kBlockAlign * kBlockAlign;
+        header.data_offset = kBlockAlign;
+
+        const std::string tmp_file = std::string(file) + ".tmp";
+        std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            std::cerr << "save disk index error: " << file << std::endl;
+            exit(-1);
+        }
+        std::vector<char> buffer(header.data_offset, 0);
+        memcpy(buffer.data(), &header, sizeof(header));
+        out.write(buffer.data(), buffer.size());
+        // 每次写出 256 个块
+        const size_t chunk = 256;
+        buffer.assign(chunk * header.block_size, 0);
+        for (size_t begin = 0; begin < node_num; begin += chunk)
+        {
+            const size_t end = std::min(node_num, begin + chunk);
+            std::fill(buffer.begin(), buffer.end(), 0);
+            for (size_t u = begin; u < end; u++)
+            {
+                char *block = buffer.data() + (u - begin) * header.block_size;
+                memcpy(block, emb + u * emb_dim, (size_t)emb_dim * sizeof(float));
+                memcpy(block + (size_t)emb_dim * sizeof(float), records.data() + record_offsets[u],
+                       record_offsets[u + 1] - record_offsets[u]);
+            }
+            out.write(buffer.data(), (end - begin) * header.block_size);
+        }
+        out.close();
+        if (!out || std::rename(tmp_file.c_str(), file) != 0)
+        {
+            std::cerr << "save disk index error: " << file << std::endl;
+            exit(-1);
+        }
+    }
+
+    bool DiskIndex::Open(const char *file, size_t node_num, unsigned emb_dim, uint64_t graph_hash, bool direct,
+                         unsigned io_threads)
+    {
+        Close();
+        int fd = open(file, O_RDONLY);
+        if (fd < 0)
+            return false;
+        Header header;
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            memcmp(header.magic, kDiskMagic, sizeof(header.magic)) != 0 || header.version != kDiskVersion ||
+            header.node_num != node_num || header.emb_dim != emb_dim || header.graph_hash != graph_hash ||
+            header.block_size % kBlockAlign != 0 || header.data_offset % kBlockAlign != 0)
+        {
+            close(fd);
+            return false;
+        }
+        if (direct)
+        {
+            int direct_fd = open(file, O_RDONLY | O_DIRECT);
+            if (direct_fd >= 0)
+            {
+                close(fd);
+                fd = direct_fd;
+            }
+            else
+            {
+                std::cerr << "O_DIRECT is not supported for " << file << ", reading through the page cache" << std::endl;
+                direct = false;
+            }
+        }
+        header_ = header;
+        fd_ = fd;
+        direct_ = direct;
+        reader_ = new BlockReader(fd_, header_.block_size, header_.data_offset, io_threads);
+        return true;
+    }
+
+    void DiskIndex::Close()
+    {
+        delete reader_;
+        reader_ = nullptr;
+        if (fd_ >= 0)
+            close(fd_);
+        fd_ = -1;
+    }
+}
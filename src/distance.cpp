@@ -0,0 +1,816 @@
+#include "distance.h"
+#include <immintrin.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace stkq
+{
+    // 各指令集的 kernel 通过函数级 target 属性单独编译, 整个库不再需要 -march=native
+    // 同一指令集内 sqr_dist / sqr_dist_bounded 及其按维数特化的版本共用一份实现, 结果完全一致;
+    // 特化版本以编译期常量作为 L 内联, 尾部分支在编译期消去
+
+    // -------------------------------- scalar --------------------------------
+
+    template <bool Bounded>
+    static inline bool ScalarSqrDist(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                     unsigned &scanned)
+    {
+        float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        unsigned i = 0;
+#pragma GCC unroll 8
+        for (; i + 4 <= L; i += 4)
+        {
+            float diff0 = a[i] - b[i];
+            float diff1 = a[i + 1] - b[i + 1];
+            float diff2 = a[i + 2] - b[i + 2];
+            float diff3 = a[i + 3] - b[i + 3];
+            sum0 += diff0 * diff0;
+            sum1 += diff1 * diff1;
+            sum2 += diff2 * diff2;
+            sum3 += diff3 * diff3;
+            if (Bounded && (i & 31) == 28 && i + 4 < L && sum0 + sum1 + sum2 + sum3 > bound_sqr)
+            {
+                scanned = i + 4;
+                return false;
+            }
+        }
+        float ret = (sum0 + sum1) + (sum2 + sum3);
+        for (; i < L; i++)
+        {
+            float diff = a[i] - b[i];
+            ret += diff * diff;
+        }
+        sqr = ret;
+        scanned = L;
+        return true;
+    }
+
+    static float ScalarSqrDist(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        ScalarSqrDist<false>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    static bool ScalarSqrDistBounded(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                     unsigned &scanned)
+    {
+        return ScalarSqrDist<true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    static void ScalarSqrDist2DBatch(const float *base, const float *q, const unsigned *ids, unsigned n, float *out)
+    {
+        for (unsigned i = 0; i < n; i++)
+        {
+            const float *p = base + (size_t)ids[i] * 2;
+            float dx = p[0] - q[0];
+            float dy = p[1] - q[1];
+            out[i] = dx * dx + dy * dy;
+        }
+    }
+
+    static uint32_t ScalarSqrDistU8(const uint8_t *a, const uint8_t *b, unsigned L)
+    {
+        uint32_t ret = 0;
+        for (unsigned i = 0; i < L; i++)
+        {
+            int diff = (int)a[i] - (int)b[i];
+            ret += diff * diff;
+        }
+        return ret;
+    }
+
+    // fp16 / bf16 与 float 之间的软件转换, 用于不支持 F16C 的 kernel 以及加载时的转换
+    static inline float HalfToFloat(uint16_t h)
+    {
+        // 指数与尾数移到 float 的对应位置后乘 2^112 重新偏置, subnormal 也由乘法得到正确的值
+        uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+        float f;
+        std::memcpy(&f, &bits, sizeof(float));
+        f *= 5.192296858534828e+33f; // 2^112
+        std::memcpy(&bits, &f, sizeof(float));
+        if ((h & 0x7c00) == 0x7c00) // inf / nan
+            bits |= 0x7f800000;
+        bits |= (uint32_t)(h & 0x8000) << 16;
+        std::memcpy(&f, &bits, sizeof(float));
+        return f;
+    }
+
+    static inline uint16_t FloatToHalf(float f)
+    {
+        uint32_t x;
+        std::memcpy(&x, &f, sizeof(float));
+        const uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t abs = x & 0x7fffffff;
+        if (abs >= 0x7f800000)
+            return (uint16_t)(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+        if (abs >= 0x477ff000) // >= 65520, 舍入后溢出为 inf
+            return (uint16_t)(sign | 0x7c00);
+        if (abs < 0x38800000) // < 2^-14, 结果为 subnormal 或 0
+        {
+            float af;
+            std::memcpy(&af, &abs, sizeof(float));
+            return (uint16_t)(sign | (uint32_t)std::nearbyint(af * 16777216.0f));
+        }
+        // 指数重新偏置, 尾数就近舍入 (ties to even)
+        abs += 0xc8000fff + ((abs >> 13) & 1);
+        return (uint16_t)(sign | (abs >> 13));
+    }
+
+    static inline float BF16ToFloat(uint16_t h)
+    {
+        const uint32_t bits = (uint32_t)h << 16;
+        float f;
+        std::memcpy(&f, &bits, sizeof(float));
+        return f;
+    }
+
+    static inline uint16_t FloatToBF16(float f)
+    {
+        uint32_t x;
+        std::memcpy(&x, &f, sizeof(float));
+        if ((x & 0x7fffffff) > 0x7f800000)
+            return (uint16_t)((x >> 16) | 0x40);
+        x += 0x7fff + ((x >> 16) & 1);
+        return (uint16_t)(x >> 16);
+    }
+
+    template <bool BF16>
+    static inline float ScalarSqrDistHalf(const float *a, const uint16_t *b, unsigned L)
+    {
+        float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        unsigned i = 0;
+        for (; i + 4 <= L; i += 4)
+        {
+            float diff0 = a[i] - (BF16 ? BF16ToFloat(b[i]) : HalfToFloat(b[i]));
+            float diff1 = a[i + 1] - (BF16 ? BF16ToFloat(b[i + 1]) : HalfToFloat(b[i + 1]));
+            float diff2 = a[i + 2] - (BF16 ? BF16ToFloat(b[i + 2]) : HalfToFloat(b[i + 2]));
+            float diff3 = a[i + 3] - (BF16 ? BF16ToFloat(b[i + 3]) : HalfToFloat(b[i + 3]));
+            sum0 += diff0 * diff0;
+            sum1 += diff1 * diff1;
+            sum2 += diff2 * diff2;
+            sum3 += diff3 * diff3;
+        }
+        float ret = (sum0 + sum1) + (sum2 + sum3);
+        for (; i < L; i++)
+        {
+            float diff = a[i] - (BF16 ? BF16ToFloat(b[i]) : HalfToFloat(b[i]));
+            ret += diff * diff;
+        }
+        return ret;
+    }
+
+    static float ScalarSqrDistF16(const float *a, const uint16_t *b, unsigned L)
+    {
+        return ScalarSqrDistHalf<false>(a, b, L);
+    }
+
+    static float ScalarSqrDistBF16(const float *a, const uint16_t *b, unsigned L)
+    {
+        return ScalarSqrDistHalf<true>(a, b, L);
+    }
+
+    // 不假设 POPCNT 指令, __builtin_popcountll 展开为位运算
+    static uint32_t ScalarHamming(const uint64_t *a, const uint64_t *b, unsigned words)
+    {
+        uint32_t ret = 0;
+        for (unsigned i = 0; i < words; i++)
+            ret += __builtin_popcountll(a[i] ^ b[i]);
+        return ret;
+    }
+
+    // --------------------------------- SSE ----------------------------------
+
+    static inline float HorizontalSum128(__m128 v)
+    {
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+
+    // Aligned 为 true 时 a, b 必须 64 字节对齐 (对 SSE / AVX2 也满足), 主循环使用对齐读取
+    template <bool Aligned>
+    static inline __m128 SSELoad(const float *p)
+    {
+        return Aligned ? _mm_load_ps(p) : _mm_loadu_ps(p);
+    }
+
+    template <bool Bounded, bool Aligned = false>
+    static inline bool SSESqrDist(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                  unsigned &scanned)
+    {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        unsigned i = 0;
+#pragma GCC unroll 8
+        for (; i + 8 <= L; i += 8)
+        {
+            __m128 diff0 = _mm_sub_ps(SSELoad<Aligned>(a + i), SSELoad<Aligned>(b + i));
+            __m128 diff1 = _mm_sub_ps(SSELoad<Aligned>(a + i + 4), SSELoad<Aligned>(b + i + 4));
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(diff0, diff0));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(diff1, diff1));
+            if (Bounded && (i & 31) == 24 && i + 8 < L && HorizontalSum128(_mm_add_ps(sum0, sum1)) > bound_sqr)
+            {
+                scanned = i + 8;
+                return false;
+            }
+        }
+        if (i + 4 <= L)
+        {
+            __m128 diff0 = _mm_sub_ps(SSELoad<Aligned>(a + i), SSELoad<Aligned>(b + i));
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(diff0, diff0));
+            i += 4;
+        }
+        float ret = HorizontalSum128(_mm_add_ps(sum0, sum1));
+        for (; i < L; i++)
+        {
+            float diff = a[i] - b[i];
+            ret += diff * diff;
+        }
+        sqr = ret;
+        scanned = L;
+        return true;
+    }
+
+    static float SSESqrDist(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        SSESqrDist<false>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    static bool SSESqrDistBounded(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                  unsigned &scanned)
+    {
+        return SSESqrDist<true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    static float SSESqrDistAligned(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        SSESqrDist<false, true>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    static bool SSESqrDistBoundedAligned(const float *a, const float *b, unsigned L, float bound_sqr, float &sqr,
+                                         unsigned &scanned)
+    {
+        return SSESqrDist<true, true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    // 每次读入 16 个编码, 扩展为 int16 后相减, madd 得到相邻两维平方和的 int32
+    static uint32_t SSESqrDistU8(const uint8_t *a, const uint8_t *b, unsigned L)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = _mm_setzero_si128();
+        unsigned i = 0;
+        for (; i + 16 <= L; i += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+            __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+            __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(lo, lo));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(hi, hi));
+        }
+        uint32_t PORTABLE_ALIGN32 tmp[4];
+        _mm_store_si128((__m128i *)tmp, sum);
+        return tmp[0] + tmp[1] + tmp[2] + tmp[3] + ScalarSqrDistU8(a + i, b + i, L - i);
+    }
+
+    // bf16 即 float 的高 16 位, 与 0 交错后直接得到 float; SSE2 没有 fp16 转换指令, fp16 沿用 scalar
+    static float SSESqrDistBF16(const float *a, const uint16_t *b, unsigned L)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        unsigned i = 0;
+        for (; i + 8 <= L; i += 8)
+        {
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+            __m128 diff0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_castsi128_ps(_mm_unpacklo_epi16(zero, vb)));
+            __m128 diff1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_castsi128_ps(_mm_unpackhi_epi16(zero, vb)));
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(diff0, diff0));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(diff1, diff1));
+        }
+        return HorizontalSum128(_mm_add_ps(sum0, sum1)) + ScalarSqrDistBF16(a + i, b + i, L - i);
+    }
+
+    // ------------------------------ AVX2 + FMA ------------------------------
+
+    __attribute__((target("avx2,fma"))) static inline float HorizontalSum256(__m256 v)
+    {
+        return HorizontalSum128(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+    }
+
+    template <bool Aligned>
+    __attribute__((target("avx2,fma"))) static inline __m256 AVX2Load(const float *p)
+    {
+        return Aligned ? _mm256_load_ps(p) : _mm256_loadu_ps(p);
+    }
+
+    template <bool Bounded, bool Aligned = false>
+    __attribute__((target("avx2,fma"))) static inline bool AVX2SqrDist(const float *a, const float *b, unsigned L,
+                                                                       float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        unsigned i = 0;
+#pragma GCC unroll 8
+        for (; i + 16 <= L; i += 16)
+        {
+            __m256 diff0 = _mm256_sub_ps(AVX2Load<Aligned>(a + i), AVX2Load<Aligned>(b + i));
+            __m256 diff1 = _mm256_sub_ps(AVX2Load<Aligned>(a + i + 8), AVX2Load<Aligned>(b + i + 8));
+            sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+            sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+            if (Bounded && (i & 31) == 16 && i + 16 < L && HorizontalSum256(_mm256_add_ps(sum0, sum1)) > bound_sqr)
+            {
+                scanned = i + 16;
+                return false;
+            }
+        }
+        if (i + 8 <= L)
+        {
+            __m256 diff0 = _mm256_sub_ps(AVX2Load<Aligned>(a + i), AVX2Load<Aligned>(b + i));
+            sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+            i += 8;
+        }
+        float ret = HorizontalSum256(_mm256_add_ps(sum0, sum1));
+        for (; i < L; i++)
+        {
+            float diff = a[i] - b[i];
+            ret += diff * diff;
+        }
+        sqr = ret;
+        scanned = L;
+        return true;
+    }
+
+    __attribute__((target("avx2,fma"))) static float AVX2SqrDist(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        AVX2SqrDist<false>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    __attribute__((target("avx2,fma"))) static bool AVX2SqrDistBounded(const float *a, const float *b, unsigned L,
+                                                                       float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        return AVX2SqrDist<true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    __attribute__((target("avx2,fma"))) static float AVX2SqrDistAligned(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        AVX2SqrDist<false, true>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    __attribute__((target("avx2,fma"))) static bool AVX2SqrDistBoundedAligned(const float *a, const float *b, unsigned L,
+                                                                              float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        return AVX2SqrDist<true, true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    // 每 8 个候选点一组, 用 gather 取出 x / y 坐标
+    __attribute__((target("avx2,fma"))) static void AVX2SqrDist2DBatch(const float *base, const float *q,
+                                                                       const unsigned *ids, unsigned n, float *out)
+    {
+        const __m256 qx = _mm256_set1_ps(q[0]);
+        const __m256 qy = _mm256_set1_ps(q[1]);
+        unsigned i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i idx = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)(ids + i)), 1);
+            __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(base, idx, 4), qx);
+            __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(base + 1, idx, 4), qy);
+            _mm256_storeu_ps(out + i, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+        }
+        ScalarSqrDist2DBatch(base, q, ids + i, n - i, out + i);
+    }
+
+    __attribute__((target("avx2,fma"))) static uint32_t AVX2SqrDistU8(const uint8_t *a, const uint8_t *b, unsigned L)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        unsigned i = 0;
+        for (; i + 16 <= L; i += 16)
+        {
+            __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+            __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+            __m256i diff = _mm256_sub_epi16(va, vb);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+        }
+        __m128i part = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        uint32_t PORTABLE_ALIGN32 tmp[4];
+        _mm_store_si128((__m128i *)tmp, part);
+        return tmp[0] + tmp[1] + tmp[2] + tmp[3] + ScalarSqrDistU8(a + i, b + i, L - i);
+    }
+
+    // 所有支持 AVX2 的 CPU 都支持 F16C, avx2 一组 kernel 选用时同时检查 f16c
+    template <bool BF16>
+    __attribute__((target("avx2,fma,f16c"))) static inline __m256 AVX2LoadHalf(const uint16_t *b)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)b);
+        if (BF16)
+            return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(v), 16));
+        return _mm256_cvtph_ps(v);
+    }
+
+    template <bool BF16>
+    __attribute__((target("avx2,fma,f16c"))) static float AVX2SqrDistHalf(const float *a, const uint16_t *b, unsigned L)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        unsigned i = 0;
+        for (; i + 16 <= L; i += 16)
+        {
+            __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), AVX2LoadHalf<BF16>(b + i));
+            __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), AVX2LoadHalf<BF16>(b + i + 8));
+            sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+            sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+        }
+        if (i + 8 <= L)
+        {
+            __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), AVX2LoadHalf<BF16>(b + i));
+            sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+            i += 8;
+        }
+        float ret = HorizontalSum256(_mm256_add_ps(sum0, sum1));
+        for (; i < L; i++)
+        {
+            float diff = a[i] - (BF16 ? BF16ToFloat(b[i]) : _cvtsh_ss(b[i]));
+            ret += diff * diff;
+        }
+        return ret;
+    }
+
+    // 支持 AVX2 的 CPU 都带有 POPCNT, avx2 / avx512 两组 kernel 共用
+    __attribute__((target("popcnt"))) static uint32_t PopcntHamming(const uint64_t *a, const uint64_t *b, unsigned words)
+    {
+        uint64_t sum0 = 0, sum1 = 0;
+        unsigned i = 0;
+        for (; i + 2 <= words; i += 2)
+        {
+            sum0 += __builtin_popcountll(a[i] ^ b[i]);
+            sum1 += __builtin_popcountll(a[i + 1] ^ b[i + 1]);
+        }
+        if (i < words)
+            sum0 += __builtin_popcountll(a[i] ^ b[i]);
+        return (uint32_t)(sum0 + sum1);
+    }
+
+    // ------------------------------- AVX-512F -------------------------------
+
+    // GCC 12 的 _mm512_reduce_add_ps / _mm512_slli_epi32 / _mm512_cvtph_ps 等内联函数以 _mm*_undefined_* 作为透传源,
+    // 内联后会对其中的 __Y 报 -Wmaybe-uninitialized / -Wuninitialized; 这些值不参与结果, 只在 AVX-512 kernel 内关闭该告警
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+    template <bool Aligned>
+    __attribute__((target("avx512f"))) static inline __m512 AVX512Load(const float *p)
+    {
+        return Aligned ? _mm512_load_ps(p) : _mm512_loadu_ps(p);
+    }
+
+    template <bool Bounded, bool Aligned = false>
+    __attribute__((target("avx512f"))) static inline bool AVX512SqrDist(const float *a, const float *b, unsigned L,
+                                                                        float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        unsigned i = 0;
+#pragma GCC unroll 8
+        for (; i + 32 <= L; i += 32)
+        {
+            __m512 diff0 = _mm512_sub_ps(AVX512Load<Aligned>(a + i), AVX512Load<Aligned>(b + i));
+            __m512 diff1 = _mm512_sub_ps(AVX512Load<Aligned>(a + i + 16), AVX512Load<Aligned>(b + i + 16));
+            sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+            sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+            if (Bounded && i + 32 < L && _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1)) > bound_sqr)
+            {
+                scanned = i + 32;
+                return false;
+            }
+        }
+        if (i + 16 <= L)
+        {
+            __m512 diff0 = _mm512_sub_ps(AVX512Load<Aligned>(a + i), AVX512Load<Aligned>(b + i));
+            sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+            i += 16;
+        }
+        // 不足 16 维的尾部用掩码读取, 掩码外的元素为 0, 不影响结果
+        if (i < L)
+        {
+            const __mmask16 tail = (__mmask16)((1u << (L - i)) - 1);
+            __m512 diff1 = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, a + i), _mm512_maskz_loadu_ps(tail, b + i));
+            sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+        }
+        sqr = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+        scanned = L;
+        return true;
+    }
+
+    __attribute__((target("avx512f"))) static float AVX512SqrDist(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        AVX512SqrDist<false>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    __attribute__((target("avx512f"))) static bool AVX512SqrDistBounded(const float *a, const float *b, unsigned L,
+                                                                        float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        return AVX512SqrDist<true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    __attribute__((target("avx512f"))) static float AVX512SqrDistAligned(const float *a, const float *b, unsigned L)
+    {
+        float sqr;
+        unsigned scanned;
+        AVX512SqrDist<false, true>(a, b, L, 0, sqr, scanned);
+        return sqr;
+    }
+
+    __attribute__((target("avx512f"))) static bool AVX512SqrDistBoundedAligned(const float *a, const float *b, unsigned L,
+                                                                               float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        return AVX512SqrDist<true, true>(a, b, L, bound_sqr, sqr, scanned);
+    }
+
+    // 每 16 个候选点一组 gather, 尾部用掩码处理
+    __attribute__((target("avx512f"))) static void AVX512SqrDist2DBatch(const float *base, const float *q,
+                                                                        const unsigned *ids, unsigned n, float *out)
+    {
+        const __m512 qx = _mm512_set1_ps(q[0]);
+        const __m512 qy = _mm512_set1_ps(q[1]);
+        for (unsigned i = 0; i < n; i += 16)
+        {
+            const __mmask16 mask = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+            __m512i idx = _mm512_slli_epi32(_mm512_maskz_loadu_epi32(mask, ids + i), 1);
+            __m512 dx = _mm512_sub_ps(_mm512_mask_i32gather_ps(qx, mask, idx, base, 4), qx);
+            __m512 dy = _mm512_sub_ps(_mm512_mask_i32gather_ps(qy, mask, idx, base + 1, 4), qy);
+            _mm512_mask_storeu_ps(out + i, mask, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+        }
+    }
+
+    template <bool BF16>
+    __attribute__((target("avx512f"))) static inline __m512 AVX512LoadHalf(const uint16_t *b)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)b);
+        if (BF16)
+            return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(v), 16));
+        return _mm512_cvtph_ps(v);
+    }
+
+    // 16 位元素的掩码读取需要 AVX-512BW, 不足 16 维的尾部交给 AVX2 版本
+    template <bool BF16>
+    __attribute__((target("avx512f"))) static float AVX512SqrDistHalf(const float *a, const uint16_t *b, unsigned L)
+    {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        unsigned i = 0;
+        for (; i + 32 <= L; i += 32)
+        {
+            __m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), AVX512LoadHalf<BF16>(b + i));
+            __m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), AVX512LoadHalf<BF16>(b + i + 16));
+            sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+            sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+        }
+        if (i + 16 <= L)
+        {
+            __m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), AVX512LoadHalf<BF16>(b + i));
+            sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+            i += 16;
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1)) + AVX2SqrDistHalf<BF16>(a + i, b + i, L - i);
+    }
+#pragma GCC diagnostic pop
+
+    // ------------------------- dimension specialized -------------------------
+
+    template <unsigned Dim>
+    static float ScalarSqrDistDim(const float *a, const float *b, unsigned)
+    {
+        float sqr;
+        unsigned scanned;
+        ScalarSqrDist<false>(a, b, Dim, 0, sqr, scanned);
+        return sqr;
+    }
+
+    template <unsigned Dim>
+    static bool ScalarSqrDistBoundedDim(const float *a, const float *b, unsigned, float bound_sqr, float &sqr,
+                                        unsigned &scanned)
+    {
+        return ScalarSqrDist<true>(a, b, Dim, bound_sqr, sqr, scanned);
+    }
+
+    template <unsigned Dim, bool Aligned = false>
+    static float SSESqrDistDim(const float *a, const float *b, unsigned)
+    {
+        float sqr;
+        unsigned scanned;
+        SSESqrDist<false, Aligned>(a, b, Dim, 0, sqr, scanned);
+        return sqr;
+    }
+
+    template <unsigned Dim, bool Aligned = false>
+    static bool SSESqrDistBoundedDim(const float *a, const float *b, unsigned, float bound_sqr, float &sqr,
+                                     unsigned &scanned)
+    {
+        return SSESqrDist<true, Aligned>(a, b, Dim, bound_sqr, sqr, scanned);
+    }
+
+    template <unsigned Dim, bool Aligned = false>
+    __attribute__((target("avx2,fma"))) static float AVX2SqrDistDim(const float *a, const float *b, unsigned)
+    {
+        float sqr;
+        unsigned scanned;
+        AVX2SqrDist<false, Aligned>(a, b, Dim, 0, sqr, scanned);
+        return sqr;
+    }
+
+    template <unsigned Dim, bool Aligned = false>
+    __attribute__((target("avx2,fma"))) static bool AVX2SqrDistBoundedDim(const float *a, const float *b, unsigned,
+                                                                          float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        return AVX2SqrDist<true, Aligned>(a, b, Dim, bound_sqr, sqr, scanned);
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+    template <unsigned Dim, bool Aligned = false>
+    __attribute__((target("avx512f"))) static float AVX512SqrDistDim(const float *a, const float *b, unsigned)
+    {
+        float sqr;
+        unsigned scanned;
+        AVX512SqrDist<false, Aligned>(a, b, Dim, 0, sqr, scanned);
+        return sqr;
+    }
+
+    template <unsigned Dim, bool Aligned = false>
+    __attribute__((target("avx512f"))) static bool AVX512SqrDistBoundedDim(const float *a, const float *b, unsigned,
+                                                                           float bound_sqr, float &sqr, unsigned &scanned)
+    {
+        return AVX512SqrDist<true, Aligned>(a, b, Dim, bound_sqr, sqr, scanned);
+    }
+#pragma GCC diagnostic pop
+
+    // 二维坐标直接展开, 不值得走向量寄存器
+    static float SqrDist2(const float *a, const float *b, unsigned)
+    {
+        float dx = a[0] - b[0];
+        float dy = a[1] - b[1];
+        return dx * dx + dy * dy;
+    }
+
+    static bool SqrDistBounded2(const float *a, const float *b, unsigned, float, float &sqr, unsigned &scanned)
+    {
+        sqr = SqrDist2(a, b, 2);
+        scanned = 2;
+        return true;
+    }
+
+    // ------------------------------- registry -------------------------------
+
+    // fp16 / bf16 与 hamming kernel 不按维数特化, 特化版本沿用下面的通用实现
+#define SCALAR_GENERIC_KERNELS ScalarSqrDistF16, ScalarSqrDistBF16, ScalarHamming
+#define SSE_GENERIC_KERNELS ScalarSqrDistF16, SSESqrDistBF16, ScalarHamming
+#define AVX2_GENERIC_KERNELS AVX2SqrDistHalf<false>, AVX2SqrDistHalf<true>, PopcntHamming
+#define AVX512_GENERIC_KERNELS AVX512SqrDistHalf<false>, AVX512SqrDistHalf<true>, PopcntHamming
+
+    static const DistanceKernels kScalarKernels = {"scalar", 0, ScalarSqrDist, ScalarSqrDistBounded, ScalarSqrDist,
+                                                   ScalarSqrDistBounded, ScalarSqrDist2DBatch, ScalarSqrDistU8,
+                                                   SCALAR_GENERIC_KERNELS};
+    static const DistanceKernels kSSEKernels = {"sse", 0, SSESqrDist, SSESqrDistBounded, SSESqrDistAligned, SSESqrDistBoundedAligned,
+                                                ScalarSqrDist2DBatch, SSESqrDistU8, SSE_GENERIC_KERNELS};
+    static const DistanceKernels kAVX2Kernels = {"avx2", 0, AVX2SqrDist, AVX2SqrDistBounded, AVX2SqrDistAligned,
+                                                 AVX2SqrDistBoundedAligned, AVX2SqrDist2DBatch, AVX2SqrDistU8,
+                                                 AVX2_GENERIC_KERNELS};
+    // AVX-512F 不含 512 位的 16 位整数运算 (需要 AVX-512BW), SQ8 kernel 沿用 AVX2 版本
+    static const DistanceKernels kAVX512Kernels = {"avx512", 0, AVX512SqrDist, AVX512SqrDistBounded, AVX512SqrDistAligned,
+                                                   AVX512SqrDistBoundedAligned, AVX512SqrDist2DBatch, AVX2SqrDistU8,
+                                                   AVX512_GENERIC_KERNELS};
+
+    template <unsigned Dim>
+    static const DistanceKernels &SpecializeDistanceKernels(const DistanceKernels &kernels)
+    {
+        static const DistanceKernels scalar = {"scalar", Dim, ScalarSqrDistDim<Dim>, ScalarSqrDistBoundedDim<Dim>, ScalarSqrDistDim<Dim>,
+                                               ScalarSqrDistBoundedDim<Dim>, ScalarSqrDist2DBatch, ScalarSqrDistU8,
+                                               SCALAR_GENERIC_KERNELS};
+        static const DistanceKernels sse = {"sse", Dim, SSESqrDistDim<Dim>, SSESqrDistBoundedDim<Dim>, SSESqrDistDim<Dim, true>,
+                                            SSESqrDistBoundedDim<Dim, true>, ScalarSqrDist2DBatch, SSESqrDistU8,
+                                            SSE_GENERIC_KERNELS};
+        static const DistanceKernels avx2 = {"avx2", Dim, AVX2SqrDistDim<Dim>, AVX2SqrDistBoundedDim<Dim>, AVX2SqrDistDim<Dim, true>,
+                                             AVX2SqrDistBoundedDim<Dim, true>, AVX2SqrDist2DBatch, AVX2SqrDistU8,
+                                             AVX2_GENERIC_KERNELS};
+        static const DistanceKernels avx512 = {"avx512", Dim, AVX512SqrDistDim<Dim>, AVX512SqrDistBoundedDim<Dim>, AVX512SqrDistDim<Dim, true>,
+                                               AVX512SqrDistBoundedDim<Dim, true>, AVX512SqrDist2DBatch, AVX2SqrDistU8,
+                                               AVX512_GENERIC_KERNELS};
+        if (&kernels == &kAVX512Kernels)
+            return avx512;
+        if (&kernels == &kAVX2Kernels)
+            return avx2;
+        if (&kernels == &kSSEKernels)
+            return sse;
+        return scalar;
+    }
+
+    const DistanceKernels &SpecializeDistanceKernels(const DistanceKernels &kernels, unsigned dim)
+    {
+        static const DistanceKernels scalar_2 = {"scalar", 2, SqrDist2, SqrDistBounded2, SqrDist2, SqrDistBounded2,
+                                                 ScalarSqrDist2DBatch, ScalarSqrDistU8, SCALAR_GENERIC_KERNELS};
+        static const DistanceKernels sse_2 = {"sse", 2, SqrDist2, SqrDistBounded2, SqrDist2, SqrDistBounded2,
+                                              ScalarSqrDist2DBatch, SSESqrDistU8, SSE_GENERIC_KERNELS};
+        static const DistanceKernels avx2_2 = {"avx2", 2, SqrDist2, SqrDistBounded2, SqrDist2, SqrDistBounded2,
+                                               AVX2SqrDist2DBatch, AVX2SqrDistU8, AVX2_GENERIC_KERNELS};
+        static const DistanceKernels avx512_2 = {"avx512", 2, SqrDist2, SqrDistBounded2, SqrDist2, SqrDistBounded2,
+                                                 AVX512SqrDist2DBatch, AVX2SqrDistU8, AVX512_GENERIC_KERNELS};
+        if (kernels.dim != 0)
+        {
+            std::cerr << "distance kernels are already specialized for dim " << kernels.dim << std::endl;
+            exit(-1);
+        }
+        switch (dim)
+        {
+        case 2:
+            if (&kernels == &kAVX512Kernels)
+                return avx512_2;
+            if (&kernels == &kAVX2Kernels)
+                return avx2_2;
+            if (&kernels == &kSSEKernels)
+                return sse_2;
+            return scalar_2;
+        case 512:
+            return SpecializeDistanceKernels<512>(kernels);
+        case 768:
+            return SpecializeDistanceKernels<768>(kernels);
+        case 1024:
+            return SpecializeDistanceKernels<1024>(kernels);
+        default:
+            return kernels;
+        }
+    }
+
+    std::vector<const DistanceKernels *> GetSupportedDistanceKernels()
+    {
+        std::vector<const DistanceKernels *> kernels;
+        __builtin_cpu_init();
+        // avx512 组的 SQ8 kernel 沿用 AVX2SqrDistU8, fp16 / bf16 kernel 的尾部沿用 AVX2SqrDistHalf,
+        // 需要同时具备 AVX2 / F16C / FMA
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c") &&
+            __builtin_cpu_supports("fma") && __builtin_cpu_supports("popcnt"))
+            kernels.push_back(&kAVX512Kernels);
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c") &&
+            __builtin_cpu_supports("popcnt"))
+            kernels.push_back(&kAVX2Kernels);
+        // x86-64 均支持 SSE2
+        kernels.push_back(&kSSEKernels);
+        kernels.push_back(&kScalarKernels);
+        return kernels;
+    }
+
+    static const DistanceKernels *SelectDistanceKernels()
+    {
+        std::vector<const DistanceKernels *> kernels = GetSupportedDistanceKernels();
+        const char *forced = std::getenv("STKQ_SIMD");
+        if (forced != nullptr && forced[0] != '\0')
+        {
+            for (const DistanceKernels *k : kernels)
+            {
+                if (std::strcmp(k->name, forced) == 0)
+                    return k;
+            }
+            std::cerr << "STKQ_SIMD=" << forced << " is not supported on this cpu, use " << kernels[0]->name
+                      << std::endl;
+        }
+        return kernels[0];
+    }
+
+    const DistanceKernels &GetDistanceKernels()
+    {
+        static const DistanceKernels *kernels = SelectDistanceKernels();
+        return *kernels;
+    }
+
+    void ConvertFloatToHalf(const float *src, uint16_t *dst, size_t n, EmbPrecision precision)
+    {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; i++)
+            dst[i] = precision == EMB_BFLOAT16 ? FloatToBF16(src[i]) : FloatToHalf(src[i]);
+    }
+
+    float HalfToFloat(uint16_t h, EmbPrecision precision)
+    {
+        return precision == EMB_BFLOAT16 ? BF16ToFloat(h) : HalfToFloat(h);
+    }
+}
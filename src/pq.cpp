@@ -0,0 +1,158 @@
+#include "pq.h"
+#include <omp.h>
+#include <random>
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+
+namespace stkq
+{
+    static inline float SubSqrDist(const float *a, const float *b, unsigned d)
+    {
+        float r = 0;
+        for (unsigned i = 0; i < d; i++)
+            r += (a[i] - b[i]) * (a[i] - b[i]);
+        return r;
+    }
+
+    // x 到 KSUB 个中心 c 中最近的一个
+    static inline unsigned NearestCentroid(const float *x, const float *c, unsigned d)
+    {
+        unsigned best = 0;
+        float best_dist = FLT_MAX;
+        for (unsigned k = 0; k < PQCodec::KSUB; k++)
+        {
+            const float dist = SubSqrDist(x, c + (size_t)k * d, d);
+            if (dist < best_dist)
+            {
+                best_dist = dist;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    // n 个 d 维向量 x 上的 Lloyd k-means, 随机选 KSUB 个不同的点初始化, 空簇重新取一个随机点
+    static void KMeans(const float *x, size_t n, unsigned d, float *c, unsigned iters, unsigned seed)
+    {
+        const unsigned K = PQCodec::KSUB;
+        std::mt19937 rng(seed);
+        std::vector<size_t> perm(n);
+        for (size_t i = 0; i < n; i++)
+            perm[i] = i;
+        for (unsigned k = 0; k < K; k++)
+        {
+            std::swap(perm[k], perm[k + rng() % (n - k)]);
+            std::memcpy(c + (size_t)k * d, x + perm[k] * d, d * sizeof(float));
+        }
+
+        std::vector<unsigned> assign(n);
+        std::vector<float> sum((size_t)K * d);
+        std::vector<size_t> count(K);
+        for (unsigned it = 0; it < iters; it++)
+        {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            std::fill(count.begin(), count.end(), 0);
+            for (size_t i = 0; i < n; i++)
+            {
+                const unsigned k = NearestCentroid(x + i * d, c, d);
+                assign[i] = k;
+                count[k]++;
+                for (unsigned j = 0; j < d; j++)
+                    sum[(size_t)k * d + j] += x[i * d + j];
+            }
+            for (unsigned k = 0; k < K; k++)
+            {
+                if (count[k] == 0)
+                {
+                    std::memcpy(c + (size_t)k * d, x + (rng() % n) * d, d * sizeof(float));
+                    continue;
+                }
+                for (unsigned j = 0; j < d; j++)
+                    c[(size_t)k * d + j] = sum[(size_t)k * d + j] / count[k];
+            }
+        }
+    }
+
+    void PQCodec::Train(const float *data, size_t n, unsigned dim, unsigned M, size_t sample, unsigned iters)
+    {
+        if (M == 0 || dim % M != 0)
+        {
+            std::cerr << "pq: embedding dim " << dim << " is not divisible by M = " << M << std::endl;
+            exit(-1);
+        }
+        if (n < KSUB)
+        {
+            std::cerr << "pq: at least " << KSUB << " base vectors are required for training" << std::endl;
+            exit(-1);
+        }
+        dim_ = dim;
+        M_ = M;
+        dsub_ = dim / M;
+
+        // 抽样, 样本数不少于中心数
+        sample = std::min(std::max(sample, (size_t)KSUB), n);
+        std::vector<size_t> ids(sample);
+        std::mt19937_64 rng(2024);
+        for (size_t i = 0; i < sample; i++)
+            ids[i] = sample == n ? i : rng() % n;
+
+        centroids_.assign((size_t)M * KSUB * dsub_, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int m = 0; m < (int)M; m++)
+        {
+            std::vector<float> x(sample * dsub_);
+            for (size_t i = 0; i < sample; i++)
+                std::memcpy(&x[i * dsub_], data + ids[i] * dim + (size_t)m * dsub_, dsub_ * sizeof(float));
+            KMeans(x.data(), sample, dsub_, &centroids_[(size_t)m * KSUB * dsub_], iters, 2024 + m);
+        }
+    }
+
+    void PQCodec::Encode(const float *data, size_t n, uint8_t *codes) const
+    {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; i++)
+        {
+            const float *x = data + i * dim_;
+            for (unsigned m = 0; m < M_; m++)
+                codes[i * M_ + m] = (uint8_t)NearestCentroid(x + (size_t)m * dsub_, &centroids_[(size_t)m * KSUB * dsub_], dsub_);
+        }
+    }
+
+    void PQCodec::ComputeTable(const float *query, float *table) const
+    {
+        for (unsigned m = 0; m < M_; m++)
+        {
+            const float *q = query + (size_t)m * dsub_;
+            const float *c = &centroids_[(size_t)m * KSUB * dsub_];
+            for (unsigned k = 0; k < KSUB; k++)
+                table[(size_t)m * KSUB + k] = SubSqrDist(q, c + (size_t)k * dsub_, dsub_);
+        }
+    }
+
+    void PQCodec::Save(std::ostream &out) const
+    {
+        out.write((char *)&dim_, sizeof(unsigned));
+        out.write((char *)&M_, sizeof(unsigned));
+        out.write((char *)centroids_.data(), centroids_.size() * sizeof(float));
+    }
+
+    bool PQCodec::Load(std::istream &in)
+    {
+        unsigned dim = 0, M = 0;
+        in.read((char *)&dim, sizeof(unsigned));
+        in.read((char *)&M, sizeof(unsigned));
+        if (!in || M == 0 || dim % M != 0)
+            return false;
+        std::vector<float> centroids((size_t)dim * KSUB);
+        in.read((char *)centroids.data(), centroids.size() * sizeof(float));
+        if (!in)
+            return false;
+        dim_ = dim;
+        M_ = M;
+        dsub_ = dim / M;
+        centroids_.swap(centroids);
+        return true;
+    }
+}
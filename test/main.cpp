@@ -1,6 +1,9 @@
 #include <builder.h>
+#include <component.h>
 #include <set_para.h>
 #include <iostream>
+#include <random>
+#include <chrono>
 
 void HNSW(stkq::Parameters &parameters)
 {
@@ -242,22 +245,447 @@ void DEG(stkq::Parameters &parameters)
         builder->search(stkq::TYPE::SEARCH_ENTRY_NONE, stkq::TYPE::ROUTER_DEG, stkq::TYPE::L_SEARCH_ASCEND, parameters);
         builder->peak_memory_footprint();
     }
+    else if (parameters.get<std::string>("exc_type") == "reorder")
+    {
+        // 离线重排已构建的索引, 覆盖原图文件并写出 <graph_file>.perm
+        builder->load(&base_emb_path[0], &base_loc_path[0], &query_emb_path[0], &query_loc_path[0], &query_alpha_path[0], &ground_path[0], parameters);
+        builder->load_graph(stkq::TYPE::INDEX_DEG, &graph_file[0]);
+        builder->reorder(stkq::TYPE::INDEX_DEG, parameters.get<std::string>("reorder", "bfs"));
+        builder->save_graph(stkq::TYPE::INDEX_DEG, &graph_file[0]);
+    }
     else
     {
         std::cout << "exc_type input error!" << std::endl;
     }
 }
 
+// 单项 kernel 检查, 返回出错的次数; 各项分开输出, 失败时可以直接看出是哪个 kernel
+typedef unsigned (*KernelCheck)(const stkq::DistanceKernels &k, std::mt19937 &rng);
+
+static const unsigned kCheckDims[] = {1, 2, 3, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 128, 200, 768, 777, 1024};
+
+// sqr_dist 与 double 精度参考值一致; sqr_dist_bounded 未提前终止时需与 sqr_dist 完全一致, 提前终止时真实距离必须超过阈值
+unsigned CheckSqrDist(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> uni(-1, 1);
+    unsigned errors = 0;
+    for (unsigned dim : kCheckDims)
+    {
+        std::vector<float> a(dim), b(dim);
+        for (unsigned t = 0; t < 200; t++)
+        {
+            for (unsigned i = 0; i < dim; i++)
+            {
+                a[i] = uni(rng);
+                b[i] = uni(rng);
+            }
+            double ref = 0;
+            for (unsigned i = 0; i < dim; i++)
+                ref += ((double)a[i] - b[i]) * ((double)a[i] - b[i]);
+            float sqr = k.sqr_dist(a.data(), b.data(), dim);
+            if (std::fabs(sqr - ref) > 1e-4 * ref + 1e-6)
+                errors++;
+
+            float bound_sqr = (float)ref * (0.5f + (uni(rng) + 1) / 2);
+            float bounded;
+            unsigned scanned;
+            if (k.sqr_dist_bounded(a.data(), b.data(), dim, bound_sqr, bounded, scanned))
+            {
+                if (bounded != sqr || scanned != dim)
+                    errors++;
+            }
+            else if (ref <= bound_sqr * (1 - 1e-4) || scanned >= dim)
+                errors++;
+        }
+    }
+    return errors;
+}
+
+// 二维坐标一对多距离, 候选数 0 ~ 40 覆盖整组与掩码尾部
+unsigned CheckSqrDist2DBatch(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> uni(-1, 1);
+    const unsigned points = 4096;
+    std::vector<float> loc(points * 2);
+    for (auto &x : loc)
+        x = uni(rng);
+    unsigned errors = 0;
+    for (unsigned n = 0; n <= 40; n++)
+    {
+        std::vector<unsigned> ids(n);
+        std::vector<float> out(n);
+        for (auto &id : ids)
+            id = rng() % points;
+        const float q[2] = {uni(rng), uni(rng)};
+        k.sqr_dist_2d_batch(loc.data(), q, ids.data(), n, out.data());
+        for (unsigned i = 0; i < n; i++)
+        {
+            double dx = (double)loc[ids[i] * 2] - q[0], dy = (double)loc[ids[i] * 2 + 1] - q[1];
+            if (std::fabs(out[i] - (dx * dx + dy * dy)) > 1e-5)
+                errors++;
+        }
+    }
+    return errors;
+}
+
+// SQ8 整数距离必须精确
+unsigned CheckSqrDistU8(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    unsigned errors = 0;
+    for (unsigned dim : kCheckDims)
+    {
+        std::vector<uint8_t> a(dim), b(dim);
+        for (unsigned t = 0; t < 50; t++)
+        {
+            uint32_t ref = 0;
+            for (unsigned i = 0; i < dim; i++)
+            {
+                a[i] = rng() & 255;
+                b[i] = rng() & 255;
+                ref += ((int)a[i] - b[i]) * ((int)a[i] - b[i]);
+            }
+            if (k.sqr_dist_u8(a.data(), b.data(), dim) != ref)
+                errors++;
+        }
+    }
+    return errors;
+}
+
+// fp16 / bf16: 与软件转换后的 double 距离一致, 转换误差不超过半个 ulp
+unsigned CheckSqrDistHalf(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> uni(-1, 1);
+    unsigned errors = 0;
+    for (stkq::EmbPrecision precision : {stkq::EMB_FLOAT16, stkq::EMB_BFLOAT16})
+    {
+        const float max_rel = precision == stkq::EMB_FLOAT16 ? 1.0f / 2048 : 1.0f / 256;
+        for (unsigned dim : kCheckDims)
+        {
+            std::vector<float> a(dim), b(dim);
+            std::vector<uint16_t> h(dim);
+            for (unsigned t = 0; t < 50; t++)
+            {
+                for (unsigned i = 0; i < dim; i++)
+                {
+                    a[i] = uni(rng);
+                    b[i] = uni(rng) * (t + 1);
+                }
+                stkq::ConvertFloatToHalf(b.data(), h.data(), dim, precision);
+                double ref = 0;
+                for (unsigned i = 0; i < dim; i++)
+                {
+                    const float x = stkq::HalfToFloat(h[i], precision);
+                    if (std::fabs(x - b[i]) > max_rel * std::fabs(b[i]))
+                        errors++;
+                    ref += ((double)a[i] - x) * ((double)a[i] - x);
+                }
+                float sqr = precision == stkq::EMB_FLOAT16 ? k.sqr_dist_f16(a.data(), h.data(), dim)
+                                                           : k.sqr_dist_bf16(a.data(), h.data(), dim);
+                if (std::fabs(sqr - ref) > 1e-4 * ref + 1e-6)
+                    errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+// hamming 距离必须精确, 码长 0 ~ 17 个 uint64 覆盖展开的主循环与尾部
+unsigned CheckHamming(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    unsigned errors = 0;
+    for (unsigned words = 0; words <= 17; words++)
+    {
+        std::vector<uint64_t> a(words), b(words);
+        uint32_t ref = 0;
+        for (unsigned i = 0; i < words; i++)
+        {
+            a[i] = ((uint64_t)rng() << 32) | rng();
+            b[i] = ((uint64_t)rng() << 32) | rng();
+            for (uint64_t x = a[i] ^ b[i]; x; x &= x - 1)
+                ref++;
+        }
+        if (k.hamming(a.data(), b.data(), words) != ref)
+            errors++;
+    }
+    return errors;
+}
+
+// 按维数特化的版本需与通用版本逐位一致, 二维坐标允许舍入误差
+unsigned CheckSpecialized(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> uni(-1, 1);
+    unsigned errors = 0;
+    for (unsigned dim : {2u, 512u, 768u, 1024u})
+    {
+        const stkq::DistanceKernels &fixed = stkq::SpecializeDistanceKernels(k, dim);
+        std::vector<float> a(dim), b(dim);
+        for (unsigned t = 0; t < 200; t++)
+        {
+            for (unsigned i = 0; i < dim; i++)
+            {
+                a[i] = uni(rng);
+                b[i] = uni(rng);
+            }
+            float sqr = k.sqr_dist(a.data(), b.data(), dim);
+            float fixed_sqr = fixed.sqr_dist(a.data(), b.data(), dim);
+            float bound_sqr = sqr * (0.5f + (uni(rng) + 1) / 2);
+            float bounded, fixed_bounded;
+            unsigned scanned, fixed_scanned;
+            bool complete = k.sqr_dist_bounded(a.data(), b.data(), dim, bound_sqr, bounded, scanned);
+            bool fixed_complete = fixed.sqr_dist_bounded(a.data(), b.data(), dim, bound_sqr, fixed_bounded, fixed_scanned);
+            if (fixed.dim != dim)
+                errors++;
+            else if (dim == 2)
+            {
+                if (std::fabs(fixed_sqr - sqr) > 1e-6 || !fixed_complete || fixed_bounded != fixed_sqr)
+                    errors++;
+            }
+            else if (fixed_sqr != sqr || complete != fixed_complete || scanned != fixed_scanned ||
+                     (complete && bounded != fixed_bounded))
+                errors++;
+        }
+    }
+    return errors;
+}
+
+// 对齐读取的版本 (输入为 64 字节对齐的存储) 需与非对齐版本逐位一致, 通用与按维数特化的版本都要检查
+unsigned CheckAligned(const stkq::DistanceKernels &k, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> uni(-1, 1);
+    unsigned errors = 0;
+    for (unsigned dim : {2u, 512u, 768u, 1024u})
+    {
+        const stkq::DistanceKernels &fixed = stkq::SpecializeDistanceKernels(k, dim);
+        float *a = (float *)stkq::AllocAlignedStorage(dim * sizeof(float), stkq::HUGE_PAGE_OFF);
+        float *b = (float *)stkq::AllocAlignedStorage(dim * sizeof(float), stkq::HUGE_PAGE_OFF);
+        for (unsigned t = 0; t < 200; t++)
+        {
+            for (unsigned i = 0; i < dim; i++)
+            {
+                a[i] = uni(rng);
+                b[i] = uni(rng);
+            }
+            const float bound_sqr = k.sqr_dist(a, b, dim) * (0.5f + (uni(rng) + 1) / 2);
+            for (const stkq::DistanceKernels *v : {&k, &fixed})
+            {
+                float bounded, aligned_bounded;
+                unsigned scanned, aligned_scanned;
+                const float v_sqr = v->sqr_dist(a, b, dim);
+                const bool v_complete = v->sqr_dist_bounded(a, b, dim, bound_sqr, bounded, scanned);
+                const bool aligned_complete = v->sqr_dist_bounded_aligned(a, b, dim, bound_sqr, aligned_bounded, aligned_scanned);
+                if (v->sqr_dist_aligned(a, b, dim) != v_sqr || aligned_complete != v_complete ||
+                    aligned_scanned != scanned || (v_complete && aligned_bounded != bounded))
+                    errors++;
+            }
+        }
+        stkq::FreeAlignedStorage(a);
+        stkq::FreeAlignedStorage(b);
+    }
+    return errors;
+}
+
+// 压缩邻接表: 各解码实现得到的有效邻居需与 CSR 搜索图的位图判断一致 (按 id 排序后比较),
+// 出度覆盖 255 以上的转义, id 差分覆盖 1 ~ 4 字节, 区间包含越界与首尾相接的情况
+// 每种解码实现单独输出结果, 全部一致时返回 true
+bool CheckAdjacency(std::mt19937 &rng)
+{
+    bool pass = true;
+    stkq::Index::DEGSearchGraph graph;
+    std::vector<std::pair<int8_t, int8_t>> ranges;
+    for (unsigned u = 0; u < 600; u++)
+    {
+        const unsigned degree = u == 7 ? 300 : rng() % 45;
+        for (unsigned j = 0; j < degree; j++)
+        {
+            ranges.clear();
+            int lo = (int)(rng() % 120) - 10;
+            for (unsigned r = rng() % 4 + 1; r > 0 && lo <= 110; r--)
+            {
+                const int hi = std::min(lo + (int)(rng() % 40), 117);
+                ranges.emplace_back(lo, hi);
+                lo = hi + 1 + (rng() % 3 == 0 ? 0 : rng() % 20);
+            }
+            graph.AddEdge(rng() >> (rng() % 32), ranges.data(), ranges.size());
+        }
+        graph.FinishNode();
+    }
+    graph.BuildActiveMasks();
+    stkq::CompressedAdjacency adjacency;
+    adjacency.Build(graph.size(), graph.offsets.data(), graph.ids.data(), graph.range_offsets.data(), graph.ranges.data());
+    std::vector<unsigned> decoded(adjacency.MaxDegree()), expected;
+    for (const stkq::AdjacencyDecoder *decoder : stkq::GetSupportedAdjacencyDecoders())
+    {
+        adjacency.SetDecoder(*decoder);
+        unsigned errors = 0;
+        for (float alpha100 : {-1.0f, 0.0f, 0.5f, 13.0f, 13.5f, 42.25f, 63.5f, 64.0f, 99.99f, 100.0f, 100.5f})
+        {
+            const stkq::Index::DEGSearchGraph::AlphaMask mask = stkq::Index::DEGSearchGraph::MakeAlphaMask(alpha100);
+            for (unsigned u = 0; u < graph.size(); u++)
+            {
+                expected.clear();
+                for (size_t base = graph.EdgeBegin(u); base < graph.EdgeEnd(u); base += 64)
+                {
+                    for (uint64_t active = graph.ActiveMask(base, (unsigned)std::min<size_t>(64, graph.EdgeEnd(u) - base), mask);
+                         active; active &= active - 1)
+                        expected.push_back(graph.ids[base + __builtin_ctzll(active)]);
+                }
+                std::sort(expected.begin(), expected.end());
+                const unsigned n = adjacency.DecodeActive(u, alpha100, decoded.data());
+                if (n != expected.size() || !std::equal(expected.begin(), expected.end(), decoded.begin()))
+                    errors++;
+            }
+        }
+        std::cout << "check adjacency " << decoder->name << ": " << (errors == 0 ? "ok" : "FAILED") << " (" << errors
+                  << " errors), " << adjacency.Bytes() / (double)graph.size() << " bytes per node vs CSR "
+                  << graph.Bytes() / (double)graph.size() << std::endl;
+        pass = pass && errors == 0;
+    }
+    return pass;
+}
+
+// 检查各指令集距离 kernel 与 double 精度参考值的一致性, 并测试其速度
+void SIMD()
+{
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<float> uni(-1, 1);
+    std::vector<const stkq::DistanceKernels *> kernels = stkq::GetSupportedDistanceKernels();
+    std::cout << "selected distance kernels: " << stkq::GetDistanceKernels().name << std::endl;
+
+    const struct
+    {
+        const char *name;
+        KernelCheck check;
+    } checks[] = {
+        {"sqr_dist", CheckSqrDist},
+        {"sqr_dist_2d_batch", CheckSqrDist2DBatch},
+        {"sqr_dist_u8", CheckSqrDistU8},
+        {"sqr_dist_f16/bf16", CheckSqrDistHalf},
+        {"hamming", CheckHamming},
+        {"specialized", CheckSpecialized},
+        {"aligned", CheckAligned},
+    };
+    bool pass = true;
+    auto report = [&pass](const stkq::DistanceKernels &k, const char *name, unsigned errors)
+    {
+        std::cout << "check " << k.name << " " << name << ": " << (errors == 0 ? "ok" : "FAILED") << " (" << errors
+                  << " errors)" << std::endl;
+        pass = pass && errors == 0;
+    };
+    for (const stkq::DistanceKernels *k : kernels)
+    {
+        for (const auto &check : checks)
+            report(*k, check.name, check.check(*k, rng));
+    }
+
+    pass = CheckAdjacency(rng) && pass;
+
+    // 768 维 embedding 距离与 64 个二维坐标的一对多距离
+    // base 与 query 均为 64 字节对齐的存储, 另测每行偏移 16 字节 (跨 cache line) 时的耗时
+    const unsigned dim = 768, base = 20000, rounds = 2000000;
+    const unsigned points = 4096;
+    std::vector<float> loc(points * 2);
+    for (auto &x : loc)
+        x = uni(rng);
+    const size_t data_len = (size_t)base * dim + 16;
+    float *data = (float *)stkq::AllocAlignedStorage(data_len * sizeof(float), stkq::HUGE_PAGE_TRANSPARENT);
+    float *query = (float *)stkq::AllocAlignedStorage(dim * sizeof(float), stkq::HUGE_PAGE_OFF);
+    for (size_t i = 0; i < data_len; i++)
+        data[i] = uni(rng);
+    for (unsigned i = 0; i < dim; i++)
+        query[i] = uni(rng);
+    std::vector<unsigned> ids(64);
+    std::vector<float> out(64);
+    for (auto &id : ids)
+        id = rng() % points;
+    for (const stkq::DistanceKernels *k : kernels)
+    {
+        float sink = 0;
+        auto s = std::chrono::high_resolution_clock::now();
+        for (unsigned r = 0; r < rounds; r++)
+            sink += k->sqr_dist(data + (size_t)(r % base) * dim, query, dim);
+        auto e = std::chrono::high_resolution_clock::now();
+        double emb_ns = std::chrono::duration<double, std::nano>(e - s).count() / rounds;
+
+        const stkq::DistanceKernels &fixed = stkq::SpecializeDistanceKernels(*k, dim);
+        s = std::chrono::high_resolution_clock::now();
+        for (unsigned r = 0; r < rounds; r++)
+            sink += fixed.sqr_dist(data + (size_t)(r % base) * dim, query, dim);
+        e = std::chrono::high_resolution_clock::now();
+        double fixed_ns = std::chrono::duration<double, std::nano>(e - s).count() / rounds;
+
+        s = std::chrono::high_resolution_clock::now();
+        for (unsigned r = 0; r < rounds; r++)
+            sink += fixed.sqr_dist_aligned(data + (size_t)(r % base) * dim, query, dim);
+        e = std::chrono::high_resolution_clock::now();
+        double aligned_ns = std::chrono::duration<double, std::nano>(e - s).count() / rounds;
+
+        s = std::chrono::high_resolution_clock::now();
+        for (unsigned r = 0; r < rounds; r++)
+            sink += fixed.sqr_dist(data + 4 + (size_t)(r % base) * dim, query, dim);
+        e = std::chrono::high_resolution_clock::now();
+        double split_ns = std::chrono::duration<double, std::nano>(e - s).count() / rounds;
+
+        s = std::chrono::high_resolution_clock::now();
+        for (unsigned r = 0; r < rounds / 10; r++)
+        {
+            k->sqr_dist_2d_batch(loc.data(), query + (r & 63), ids.data(), 64, out.data());
+            sink += out[r & 63];
+        }
+        e = std::chrono::high_resolution_clock::now();
+        double loc_ns = std::chrono::duration<double, std::nano>(e - s).count() / (rounds / 10);
+        std::cout << "bench " << k->name << ": sqr_dist(768) " << emb_ns << " ns, specialized sqr_dist<768> " << fixed_ns
+                  << " ns (aligned loads " << aligned_ns << " ns, rows offset by 16 bytes " << split_ns
+                  << " ns), sqr_dist_2d_batch(64) " << loc_ns << " ns (" << sink << ")" << std::endl;
+    }
+    stkq::FreeAlignedStorage(data);
+    stkq::FreeAlignedStorage(query);
+    if (!pass)
+        exit(-1);
+}
+
 int main(int argc, char **argv)
 {
     // ./test/main baseline1 openimage 0.5 1 1 build
     // ./test/main baseline2 openimage 0.5 1 1 build
     // ./test/main deg openimage 0.5 1 1 build
+    // ./test/main deg openimage 0.5 1 1 search fp16
+    // ./test/main deg openimage 0.5 1 1 reorder rcm
+    // ./test/main deg howto100m 0.5 1.42 16 search prefetch_distance=8
+    // ./test/main simd
+    // ./test/main convert base_emb.fvecs [alignment]
 
-    if (argc != 7)
+    if (argc == 2 && std::string(argv[1]) == "simd")
     {
-        std::cout << "./main algorithm dataset alpha maximum_spatial_distance maximum_emb_distance exc_type"
+        SIMD();
+        return 0;
+    }
+
+    // fvecs / ivecs 转换为原生格式, 写到旁边的 <file>.stkq, 之后加载时自动优先使用
+    if ((argc == 3 || argc == 4) && std::string(argv[1]) == "convert")
+    {
+        stkq::ComponentLoad::ConvertToNative(argv[2], (std::string(argv[2]) + ".stkq").c_str(),
+                                             argc == 4 ? (unsigned)std::stoul(argv[3]) : 4);
+        return 0;
+    }
+
+    // 第 7 个参数之后: 至多一个不含 '=' 的参数 (见下), 以及任意个 key=value 选项 (见 set_para.h 中的 search_options)
+    std::vector<std::string> options;
+    std::string extra;
+    bool usage = argc < 7;
+    for (int i = 7; i < argc; i++)
+    {
+        if (std::string(argv[i]).find('=') != std::string::npos)
+            options.push_back(argv[i]);
+        else if (extra.empty())
+            extra = argv[i];
+        else
+            usage = true;
+    }
+    if (usage)
+    {
+        std::cout << "./main algorithm dataset alpha maximum_spatial_distance maximum_emb_distance exc_type [float|fp16|bf16 for search, bfs|rcm|hilbert for reorder] [key=value ...]"
                   << std::endl;
+        print_options();
         exit(-1);
     }
 
@@ -287,7 +715,14 @@ int main(int argc, char **argv)
     std::string graph_file(alg + "_" + dataset + ".index");
     parameters.set<std::string>("graph_file", index_path + graph_file);
     parameters.set<std::string>("exc_type", exc_type);
+    // 第 7 个参数: search 时为 base embedding 的存储精度 (半精度只用于 DEG 搜索), reorder 时为重排方法
+    if (!extra.empty() && exc_type == "reorder")
+        parameters.set<std::string>("reorder", extra);
+    else
+        parameters.set<std::string>("emb_precision", extra.empty() ? "float" : extra);
     set_para(alg, dataset, parameters);
+    for (const std::string &option : options)
+        set_option(option, parameters);
 
     if (alg == "baseline1")
     {